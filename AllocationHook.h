@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h>
+
+#include "MemoryUsage.h"
+
+/*
+ * Replacements of the global operator new and delete that count each thread's
+ * allocations (see AllocationCounts). Sizes are taken from malloc_usable_size()
+ * (glibc), so that delete doesn't need to know them and the counts include
+ * malloc's rounding. As these replace the global operators, include this
+ * header in exactly one translation unit of a program. They are kept out of
+ * line, where GCC would otherwise warn about free() on memory from new.
+ */
+
+__attribute__((noinline)) void *operator new(size_t size) {
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) throw std::bad_alloc();
+    AllocationCounts::local().allocated(malloc_usable_size(ptr));
+    return ptr;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr != nullptr) AllocationCounts::local().allocated(malloc_usable_size(ptr));
+    return ptr;
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+    return operator new(size, tag);
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept {
+    if (ptr == nullptr) return;
+    AllocationCounts::local().freed(malloc_usable_size(ptr));
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    operator delete(ptr);
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "BPString.h"
+#include "Common.h"
+#include "Labels.h"
+#include "MappedTopDag.h"
+#include "Timer.h"
+#include "Traversal.h"
+#include "XML.h"
+
+/// On-disk balanced parenthesis tree layout
+/**
+ * Stores a tree as its balanced parenthesis sequence and the label IDs of its
+ * nodes in preorder, so it can be loaded without parsing XML. All sections are
+ * arrays of 64-bit words. The file consists of
+ * - the header (see BPFileHeader)
+ * - the parentheses, bit `i` being bit `i % 64` of word `i / 64`, coded as in
+ *   BPString (OPEN = 0, CLOSE = 1)
+ * - the nodes' label IDs in preorder, as 32-bit integers
+ * - the label dictionary: offsets of every distinct label into the label data (plus
+ *   the end offset), followed by the label data (see DagLabelSerialiser)
+ */
+struct BPFileHeader {
+    static const uint64_t expectedMagic = 0x3130504245455254ull; // "TREEBP01"
+
+    uint64_t magic;
+    uint64_t numNodes;
+    uint64_t numLabels;
+    /// Section offsets in words from the start of the file
+    uint64_t parenthesesOffset, labelIdOffset, labelOffsetsOffset, labelDataOffset;
+    /// Total file size in words
+    uint64_t numWords;
+};
+
+/// Read and write trees in the balanced parenthesis file format
+struct BPFile {
+    /// Check whether a file starts like a BP file
+    static bool isBPFile(const std::string &filename) {
+        std::ifstream in(filename.c_str(), std::ios::binary | std::ios::in);
+        uint64_t magic(0);
+        in.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+        return in.good() && magic == BPFileHeader::expectedMagic;
+    }
+
+    /// Write a tree and its labels to a file
+    /// \param tree the tree to write, rooted at node 0
+    /// \param labels the nodes' labels
+    /// \param filename output filename (path must exist)
+    /// \returns whether the file could be written
+    template <typename TreeType, typename DataType>
+    static bool write(const TreeType &tree, const Labels<DataType> &labels, const std::string &filename) {
+        BPFileHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = BPFileHeader::expectedMagic;
+        header.numNodes = tree._numNodes;
+        header.numLabels = labels.valueIndex.size();
+
+        std::vector<uint64_t> parentheses((2 * header.numNodes + 63) / 64, 0);
+        std::vector<uint32_t> labelIds;
+        labelIds.reserve(header.numNodes + 1);
+        uint64_t pos(0);
+        traverseTree(tree, 0,
+            [&](const int nodeId, const int) {
+                labelIds.push_back(labels.keys[nodeId]);
+                ++pos; // OPEN
+            },
+            [&](const int, const int) {
+                parentheses[pos / 64] |= (uint64_t)1 << (pos % 64); // CLOSE
+                ++pos;
+            });
+        assert(pos == 2 * header.numNodes);
+        if (labelIds.size() % 2 != 0) labelIds.push_back(0);
+
+        // Label dictionary
+        std::string labelData;
+        std::vector<uint64_t> labelOffsets;
+        for (const DataType *label : labels.valueIndex) {
+            labelOffsets.push_back(labelData.size());
+            DagLabelSerialiser<DataType>::append(*label, labelData);
+        }
+        labelOffsets.push_back(labelData.size());
+        labelData.resize(((labelData.size() + 7) / 8) * 8, '\0');
+
+        // Lay out the sections
+        header.parenthesesOffset = (sizeof(header) + 7) / 8;
+        header.labelIdOffset = header.parenthesesOffset + parentheses.size();
+        header.labelOffsetsOffset = header.labelIdOffset + labelIds.size() / 2;
+        header.labelDataOffset = header.labelOffsetsOffset + labelOffsets.size();
+        header.numWords = header.labelDataOffset + labelData.size() / 8;
+
+        std::ofstream out(filename.c_str(), std::ios::binary | std::ios::out);
+        if (!out.is_open()) return false;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(parentheses.data()), parentheses.size() * sizeof(uint64_t));
+        out.write(reinterpret_cast<const char *>(labelIds.data()), labelIds.size() * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char *>(labelOffsets.data()), labelOffsets.size() * sizeof(uint64_t));
+        out.write(labelData.data(), labelData.size());
+        return out.good();
+    }
+
+    /// Check that a header's sections are in order, within the file, and large enough
+    /// for its numbers of nodes and labels, so that read() stays within the file
+    static bool isValidLayout(const BPFileHeader &header) {
+        const uint64_t headerWords = (sizeof(header) + 7) / 8;
+        if (header.parenthesesOffset < headerWords || header.labelIdOffset < header.parenthesesOffset ||
+            header.labelOffsetsOffset < header.labelIdOffset || header.labelDataOffset < header.labelOffsetsOffset ||
+            header.numWords < header.labelDataOffset) {
+            return false;
+        }
+        // nodes are numbered with ints, and each has two parentheses and a 32-bit label ID
+        return header.numNodes <= (uint64_t)std::numeric_limits<int>::max() &&
+               header.numNodes <= (header.labelIdOffset - header.parenthesesOffset) * 32 &&
+               header.numNodes <= (header.labelOffsetsOffset - header.labelIdOffset) * 2 &&
+               header.numLabels < header.labelDataOffset - header.labelOffsetsOffset; // plus the end offset
+    }
+
+    /// Read a tree and its labels from a file written by write()
+    /// \param filename the file to read
+    /// \param tree an empty tree. Its nodes are numbered in preorder, see BPString::buildTree
+    /// \param labels empty labels
+    /// \returns whether the file could be read
+    template <typename TreeType, typename DataType>
+    static bool read(const std::string &filename, TreeType &tree, Labels<DataType> &labels, const bool verbose = true) {
+        if (verbose) cout << "Reading " << filename << "… " << std::flush;
+        Timer timer;
+
+        std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+        if (!in.is_open()) return false;
+        const uint64_t length = in.tellg();
+        if (length < sizeof(BPFileHeader) || length % 8 != 0) return false;
+        std::vector<uint64_t> data(length / 8);
+        in.seekg(0);
+        in.read(reinterpret_cast<char *>(data.data()), length);
+        const BPFileHeader *header = reinterpret_cast<const BPFileHeader *>(data.data());
+        if (!in.good() || header->magic != BPFileHeader::expectedMagic || header->numWords * 8 != length ||
+            !isValidLayout(*header)) {
+            return false;
+        }
+
+        if (verbose) cout << timer.getAndReset() << "ms; building tree… " << std::flush;
+        const uint64_t *parentheses = data.data() + header->parenthesesOffset;
+        if (!BPString::buildTree(tree, 2 * header->numNodes, [&](const size_t pos) {
+                return ((parentheses[pos / 64] >> (pos % 64)) & 1) == BPString::OPEN;
+            })) {
+            return false;
+        }
+
+        // Insert the dictionary in order, so that the label IDs can be used as they are
+        const uint64_t *offsets = data.data() + header->labelOffsetsOffset;
+        const char *labelData = reinterpret_cast<const char *>(data.data() + header->labelDataOffset);
+        const uint64_t labelDataBytes = (header->numWords - header->labelDataOffset) * 8;
+        if (offsets[0] != 0) return false;
+        for (uint64_t labelId = 0; labelId < header->numLabels; ++labelId) {
+            const uint64_t labelLength = offsets[labelId + 1] - offsets[labelId];
+            if (offsets[labelId + 1] < offsets[labelId] || offsets[labelId + 1] > labelDataBytes ||
+                !DagLabelSerialiser<DataType>::isValidLength(labelLength)) {
+                return false;
+            }
+            const int valueId = labels.insert(DagLabelSerialiser<DataType>::read(labelData + offsets[labelId], labelLength));
+            if (valueId != (int)labelId) return false; // duplicate label
+        }
+        const uint32_t *labelIds = reinterpret_cast<const uint32_t *>(data.data() + header->labelIdOffset);
+        for (uint64_t nodeId = 0; nodeId < header->numNodes; ++nodeId) {
+            if (labelIds[nodeId] >= header->numLabels) return false;
+        }
+        labels.keys.assign(labelIds, labelIds + header->numNodes);
+
+        if (verbose) cout << timer.get() << "ms." << endl;
+        return true;
+    }
+};
+
+/// Read a tree from a BP file (see BPFile) or from an XML file
+template <typename TreeType>
+bool readTreeFile(const std::string &filename, TreeType &tree, Labels<std::string> &labels, const bool verbose = true) {
+    if (BPFile::isBPFile(filename)) {
+        return BPFile::read(filename, tree, labels, verbose);
+    }
+    return XmlParser<TreeType>::parse(filename, tree, labels, verbose);
+}
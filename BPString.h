@@ -1,12 +1,16 @@
 #pragma once
 
-#include <functional>
+#include <algorithm>
+#include <cassert>
+#include <iterator>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "Labels.h"
 #include "OrderedTree.h"
+#include "Traversal.h"
 
 /// Convert tree to BP string & label char collection
 struct BPString {
@@ -23,23 +27,89 @@ struct BPString {
         bpstring.clear();
         bpstring.reserve(2*tree._numNodes);
 
-        // Recursive construction of the output
-        const std::function<void (const int)> parseStructure([&](const int nodeId) {
-            const auto &label(labels[nodeId]);
-            std::copy(label.cbegin(), label.cend(), std::back_inserter(labelNames));
-            labelNames.push_back(0);
+        traverseTree(tree, 0,
+            [&](const int nodeId, const int) {
+                const auto &label(labels[nodeId]);
+                std::copy(label.cbegin(), label.cend(), std::back_inserter(labelNames));
+                labelNames.push_back(0);
 
-            bpstring.push_back(OPEN);
+                bpstring.push_back(OPEN);
+            },
+            [&](const int, const int) { bpstring.push_back(CLOSE); });
+    };
+
+    /// The inverse of fromTree(): build an OrderedTree from a balanced parenthesis
+    /// bitstring and a nullbyte-separated label vector
+    /// \param tree an empty tree
+    /// \returns whether the input was valid
+    template <typename NodeType, typename EdgeType>
+    static bool toTree(const std::vector<bool> &bpstring, const std::vector<unsigned char> &labelNames,
+                       OrderedTree<NodeType, EdgeType> &tree, LabelsT<std::string> &labels) {
+        if (!buildTree(tree, bpstring.size(), [&](const size_t i) { return bpstring[i] == OPEN; })) {
+            return false;
+        }
+        auto begin = labelNames.cbegin();
+        for (int nodeId = 0; nodeId < tree._numNodes; ++nodeId) {
+            const auto end = std::find(begin, labelNames.cend(), 0);
+            if (end == labelNames.cend()) return false;
+            labels.set(nodeId, std::string(begin, end));
+            begin = end + 1;
+        }
+        return begin == labelNames.cend();
+    }
+
+    /// Build an OrderedTree from a balanced parenthesis sequence in a single pass
+    /**
+     * Nodes are numbered in preorder. The open nodes are kept on a stack, and
+     * their children's IDs on another one. When a node is closed, its children
+     * are written as one block of edges. The tree is thus compact (no gaps in
+     * the edge array), but the blocks are in postorder instead of node order.
+     *
+     * \param tree an empty tree
+     * \param length the number of parentheses
+     * \param isOpen called as `isOpen(i)`, whether the i-th parenthesis is an opening one
+     * \returns whether the sequence was a single balanced tree
+     */
+    template <typename TreeType, typename IsOpen>
+    static bool buildTree(TreeType &tree, const size_t length, const IsOpen &isOpen) {
+        typedef typename TreeType::edgeType EdgeType;
+        assert(tree._numNodes == 0);
+        const int numNodes = length / 2;
+        if (numNodes == 0 || length % 2 != 0) return false;
+        // the dummy edge plus one edge per non-root node
+        tree.nodes.resize(numNodes);
+        tree.edges.resize(numNodes);
 
-            FORALL_OUTGOING_EDGES(tree, nodeId, edge) {
-                if (edge->valid) {
-                    parseStructure(edge->headNode);
+        // the open nodes and the position of their first child on `children`
+        std::vector<std::pair<int, size_t>> path;
+        std::vector<int> children;
+        int nextNode(0), nextEdge(1);
+        for (size_t i = 0; i < length; ++i) {
+            if (isOpen(i)) {
+                if (nextNode == numNodes || (path.empty() && nextNode > 0)) return false;
+                if (!path.empty()) children.push_back(nextNode);
+                tree.nodes[nextNode].parent = path.empty() ? -1 : path.back().first;
+                path.emplace_back(nextNode++, children.size());
+            } else {
+                if (path.empty()) return false;
+                const int nodeId = path.back().first;
+                const size_t firstChild = path.back().second;
+                tree.nodes[nodeId].firstEdgeIndex = nextEdge;
+                for (size_t child = firstChild; child < children.size(); ++child) {
+                    EdgeType &edge = tree.edges[nextEdge++];
+                    edge.valid = true;
+                    edge.headNode = children[child];
                 }
+                tree.nodes[nodeId].lastEdgeIndex = nextEdge - 1;
+                children.resize(firstChild);
+                path.pop_back();
             }
+        }
+        if (!path.empty()) return false;
 
-            bpstring.push_back(CLOSE);
-        });
-
-        parseStructure(0);
-    };
+        tree._numNodes = tree._firstFreeNode = numNodes;
+        tree._numEdges = numNodes - 1;
+        tree._firstFreeEdge = nextEdge;
+        return true;
+    }
 };
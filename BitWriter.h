@@ -1,12 +1,56 @@
 #pragma once
 
+#include <algorithm>
 #include <bitset>
+#include <cassert>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
 
+/// Append-only buffer of bits, packed into 64-bit words (MSB first)
+struct BitBuffer {
+    BitBuffer() : words(), numBits(0) {}
+
+    /// Append the `length` least significant bits of `bits`, most significant bit first
+    void append(const uint64_t bits, const unsigned int length) {
+        assert(length <= 64);
+        if (length == 0) return;
+        const unsigned int used = numBits % 64;
+        if (used == 0) {
+            words.push_back(0);
+        }
+        const unsigned int free = 64 - used;
+        const uint64_t data = (length == 64) ? bits : (bits & ((1ull << length) - 1));
+        if (length <= free) {
+            words.back() |= data << (free - length);
+        } else {
+            words.back() |= data >> (length - free);
+            words.push_back(data << (64 - (length - free)));
+        }
+        numBits += length;
+    }
+
+    /// Get the i-th bit
+    bool operator[](const size_t i) const {
+        return (words[i / 64] >> (63 - i % 64)) & 1;
+    }
+
+    size_t size() const {
+        return numBits;
+    }
+
+    void clear() {
+        words.clear();
+        numBits = 0;
+    }
+
+    std::vector<uint64_t> words;
+    size_t numBits;
+};
+
 /// Unfinished, untested, unused bit writer
 class BitWriter {
 public:
@@ -23,19 +67,37 @@ public:
         }
     }
 
-    void writeBits(int data, size_t length) {
-        for (unsigned int i = length; i--;) {
-            std::cout << "Processing bit " << i << " of " << length << ": ORing buffer[" << bufitem << "] with " << (((data >> i) & 0x1) << itempos) << " (itempos " << itempos << ")" << std::endl;
-            buffer[bufitem] |= ((data >> i) & 0x1) << itempos;
-            bufitem += (itempos == 0);
-            itempos = (itempos - 1) & 0x7;
-
-            if (bufitem == buffersize) {
-                writeBuffer();
+    /// Write the `length` least significant bits of `data`, most significant bit first.
+    /// Fills up the current byte in one go instead of going bit by bit.
+    void writeBits(const uint64_t data, unsigned int length) {
+        while (length > 0) {
+            const unsigned int chunk = std::min(length, itempos + 1);
+            length -= chunk;
+            const unsigned char bits = (data >> length) & ((1u << chunk) - 1);
+            buffer[bufitem] |= bits << (itempos + 1 - chunk);
+            if (chunk == itempos + 1) {
+                itempos = 7;
+                if (++bufitem == buffersize) {
+                    writeBuffer();
+                }
+            } else {
+                itempos -= chunk;
             }
         }
     }
 
+    /// Write a packed bit buffer, a word at a time
+    void writeBits(const BitBuffer &bits) {
+        const size_t fullWords = bits.size() / 64;
+        for (size_t i = 0; i < fullWords; ++i) {
+            writeBits(bits.words[i], 64);
+        }
+        const unsigned int rest = bits.size() % 64;
+        if (rest > 0) {
+            writeBits(bits.words[fullWords] >> (64 - rest), rest);
+        }
+    }
+
     void writeBits(const std::vector<bool> &vec) {
         for (bool bit : vec) {
             buffer[bufitem] |= bit << itempos;
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/// Integers that BufferedWriter formats itself: all but bool and the character types
+template <typename T>
+struct isFormattedInteger
+    : std::integral_constant<bool, std::is_integral<T>::value && !std::is_same<T, bool>::value &&
+                                       !std::is_same<T, char>::value && !std::is_same<T, signed char>::value &&
+                                       !std::is_same<T, unsigned char>::value> {};
+
+/// Buffered writer for text output
+/**
+ * Collects output in a fixed-size buffer and hands it to the underlying
+ * stream in large blocks. Unlike writing to std::cout with std::endl, this
+ * never flushes the stream on a newline.
+ */
+class BufferedWriter {
+public:
+    /// \param out the stream to write to
+    /// \param capacity size of the buffer in bytes
+    BufferedWriter(std::ostream &out, const size_t capacity = 1 << 16) : out(out), buffer(capacity), pos(0) {}
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    ~BufferedWriter() {
+        flush();
+    }
+
+    /// Write `length` bytes
+    void write(const char *data, size_t length) {
+        if (pos + length > buffer.size()) {
+            flush();
+            if (length > buffer.size()) {
+                out.write(data, length);
+                return;
+            }
+        }
+        memcpy(buffer.data() + pos, data, length);
+        pos += length;
+    }
+
+    /// Write a single character
+    void put(const char c) {
+        if (pos == buffer.size()) flush();
+        buffer[pos++] = c;
+    }
+
+    /// Write `count` copies of a character (e.g. for indentation)
+    void fill(const char c, size_t count) {
+        while (count > 0) {
+            if (pos == buffer.size()) flush();
+            const size_t chunk = std::min(count, buffer.size() - pos);
+            memset(buffer.data() + pos, c, chunk);
+            pos += chunk;
+            count -= chunk;
+        }
+    }
+
+    BufferedWriter &operator<<(const std::string &str) {
+        write(str.data(), str.size());
+        return *this;
+    }
+
+    BufferedWriter &operator<<(const char *str) {
+        write(str, strlen(str));
+        return *this;
+    }
+
+    BufferedWriter &operator<<(const char c) {
+        put(c);
+        return *this;
+    }
+
+    BufferedWriter &operator<<(const bool value) {
+        put(value ? '1' : '0');
+        return *this;
+    }
+
+    /// Write an integer, formatted directly into the buffer
+    template <typename T>
+    typename std::enable_if<isFormattedInteger<T>::value, BufferedWriter &>::type operator<<(const T value) {
+        char digits[24]; // enough for 64 bits and a sign
+        char *const end = digits + sizeof(digits);
+        char *const begin = formatInteger(value, end, std::is_signed<T>());
+        write(begin, end - begin);
+        return *this;
+    }
+
+    /// Write a floating-point number like the underlying stream's default format (`%g` with its precision)
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value, BufferedWriter &>::type operator<<(const T value) {
+        if (pos + maxFloatLength > buffer.size()) flush();
+        const int length = snprintf(buffer.data() + pos, buffer.size() - pos, "%.*Lg", (int)out.precision(),
+                                    (long double)value);
+        if (length > 0 && pos + length < buffer.size()) {
+            pos += length;
+        } else {
+            // didn't fit into an almost empty buffer, let the stream format it
+            flush();
+            out << value;
+        }
+        return *this;
+    }
+
+    /// Write any other type through the underlying stream's formatting
+    template <typename T>
+    typename std::enable_if<!isFormattedInteger<T>::value && !std::is_floating_point<T>::value &&
+                                !std::is_same<T, bool>::value,
+                            BufferedWriter &>::type
+    operator<<(const T &value) {
+        flush();
+        out << value;
+        return *this;
+    }
+
+    /// Hand the buffered data to the underlying stream (this does not flush the stream)
+    void flush() {
+        if (pos > 0) {
+            out.write(buffer.data(), pos);
+            pos = 0;
+        }
+    }
+
+protected:
+    /// room for the longest `%g` output at the usual precisions, so that short numbers don't need a flush
+    static const size_t maxFloatLength = 32;
+
+    /// Write an unsigned integer's digits backwards, ending before `end`
+    /// \returns the first digit
+    template <typename T>
+    static char *formatInteger(T value, char *end, std::false_type) {
+        do {
+            *--end = '0' + value % 10;
+            value /= 10;
+        } while (value != 0);
+        return end;
+    }
+
+    /// Write a signed integer's digits backwards, ending before `end`
+    /// \returns the first character
+    template <typename T>
+    static char *formatInteger(const T value, char *end, std::true_type) {
+        typedef typename std::make_unsigned<T>::type Unsigned;
+        // negate in unsigned arithmetic, which also works for the minimum value
+        const bool negative = value < 0;
+        const Unsigned magnitude = negative ? Unsigned(Unsigned(0) - Unsigned(value)) : Unsigned(value);
+        char *begin = formatInteger(magnitude, end, std::false_type());
+        if (negative) *--begin = '-';
+        return begin;
+    }
+
+    std::ostream &out;
+    std::vector<char> buffer;
+    size_t pos;
+};
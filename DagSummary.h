@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Common.h"
+#include "TopDag.h"
+
+/// Aggregate information about the cluster represented by a DAG node
+struct ClusterSummary {
+    /// number of tree nodes in the cluster, not counting its top boundary node
+    long long numNodes;
+    /// depth of the bottom boundary node below the top boundary node, -1 if there is none
+    int boundaryDepth;
+    /// number of children of the top boundary node within the cluster
+    long long topFanout;
+    /// depth of the deepest node of the cluster below the top boundary node
+    int height;
+
+    ClusterSummary() : numNodes(0), boundaryDepth(-1), topFanout(0), height(0) {}
+
+    friend std::ostream &operator<<(std::ostream &os, const ClusterSummary &summary) {
+        return os << "(" << summary.numNodes << " nodes; bbn depth " << summary.boundaryDepth
+                  << "; fanout " << summary.topFanout << "; height " << summary.height << ")";
+    }
+};
+
+/// Per-node summaries of a Top DAG
+/**
+ * Every leaf cluster is the edge from a node's parent to the node, so it contributes
+ * one node (the root's leaf is a loop, its "parent" is a virtual node above the root).
+ * Summaries of inner nodes are combined from their children's according to the
+ * merge type. Optionally, each node also stores a sparse histogram of the labels of
+ * the nodes in its cluster.
+ *
+ * DAGType can be TopDag or anything else that provides `nodes[i]` and `nodes.size()`.
+ */
+template <typename DataType, typename DAGType = TopDag<DataType>>
+class DagSummaries {
+public:
+    /// Sparse label histogram: pairs of (label ID, count), sorted by label ID
+    typedef std::vector<std::pair<int, long long>> Histogram;
+
+    /// Compute the summaries
+    /// \param dag the Top DAG to summarise
+    /// \param withHistograms whether to compute label histograms for all nodes
+    DagSummaries(const DAGType &dag, const bool withHistograms = false)
+        : summaries(dag.nodes.size()), histograms(), labelIds(), withHistograms(withHistograms) {
+        if (withHistograms) histograms.resize(dag.nodes.size());
+        // Nodes are stored in the order of their creation, i.e., in a post-order of
+        // the DAG, so the children's summaries are always available.
+        for (size_t nodeId = 1; nodeId < dag.nodes.size(); ++nodeId) {
+            const DagNode<DataType> node = dag.nodes[nodeId];
+            if (node.left < 0) {
+                summarizeLeaf(nodeId, node);
+            } else {
+                summarizeInner(nodeId, node);
+            }
+        }
+    }
+
+    /// Get the summary of a node
+    const ClusterSummary &operator[](const int nodeId) const {
+        return summaries[nodeId];
+    }
+
+    bool hasHistograms() const {
+        return withHistograms;
+    }
+
+    /// Number of nodes with a given label in a node's cluster (requires histograms)
+    long long countLabel(const int nodeId, const DataType &label) const {
+        assert(withHistograms);
+        auto it = labelIds.find(label);
+        if (it == labelIds.end()) return 0;
+        const Histogram &histogram = histograms[nodeId];
+        auto entry = std::lower_bound(histogram.begin(), histogram.end(), std::make_pair(it->second, 0ll));
+        return (entry != histogram.end() && entry->first == it->second) ? entry->second : 0;
+    }
+
+    /// Get the size of the summaries in bytes
+    size_t getSize() const {
+        size_t size = summaries.size() * sizeof(ClusterSummary);
+        for (const Histogram &histogram : histograms) {
+            size += histogram.size() * sizeof(Histogram::value_type);
+        }
+        return size;
+    }
+
+protected:
+    void summarizeLeaf(const size_t nodeId, const DagNode<DataType> &node) {
+        ClusterSummary &summary = summaries[nodeId];
+        summary.numNodes = 1;
+        summary.boundaryDepth = 1;
+        summary.topFanout = 1;
+        summary.height = 1;
+        if (withHistograms) {
+            assert(node.label != NULL);
+            auto it = labelIds.emplace(*node.label, (int)labelIds.size()).first;
+            histograms[nodeId].emplace_back(it->second, 1);
+        }
+    }
+
+    void summarizeInner(const size_t nodeId, const DagNode<DataType> &node) {
+        const ClusterSummary &left = summaries[node.left], &right = summaries[node.right];
+        ClusterSummary &summary = summaries[nodeId];
+        summary.numNodes = left.numNodes + right.numNodes;
+        if (node.mergeType == VERT_WITH_BBN || node.mergeType == VERT_NO_BBN) {
+            // right hangs below left's bottom boundary node
+            summary.height = std::max(left.height, left.boundaryDepth + right.height);
+        } else {
+            summary.height = std::max(left.height, right.height);
+        }
+        switch (node.mergeType) {
+        case VERT_WITH_BBN:
+            // the lower part may have no bbn after all (this happens at the root)
+            summary.boundaryDepth = (right.boundaryDepth < 0) ? -1 : left.boundaryDepth + right.boundaryDepth;
+            summary.topFanout = left.topFanout;
+            break;
+        case VERT_NO_BBN:
+            summary.boundaryDepth = -1;
+            summary.topFanout = left.topFanout;
+            break;
+        case HORZ_LEFT_BBN:
+            summary.boundaryDepth = left.boundaryDepth;
+            summary.topFanout = left.topFanout + right.topFanout;
+            break;
+        case HORZ_RIGHT_BBN:
+            summary.boundaryDepth = right.boundaryDepth;
+            summary.topFanout = left.topFanout + right.topFanout;
+            break;
+        case HORZ_NO_BBN:
+            summary.boundaryDepth = -1;
+            summary.topFanout = left.topFanout + right.topFanout;
+            break;
+        default:
+            assert(false);
+        }
+        if (withHistograms) {
+            mergeHistograms(histograms[node.left], histograms[node.right], histograms[nodeId]);
+        }
+    }
+
+    static void mergeHistograms(const Histogram &left, const Histogram &right, Histogram &result) {
+        result.reserve(left.size() + right.size());
+        auto l = left.begin(), r = right.begin();
+        while (l != left.end() && r != right.end()) {
+            if (l->first < r->first) {
+                result.push_back(*l++);
+            } else if (r->first < l->first) {
+                result.push_back(*r++);
+            } else {
+                result.emplace_back(l->first, l->second + r->second);
+                ++l, ++r;
+            }
+        }
+        result.insert(result.end(), l, left.end());
+        result.insert(result.end(), r, right.end());
+        result.shrink_to_fit();
+    }
+
+    std::vector<ClusterSummary> summaries;
+    std::vector<Histogram> histograms;
+    std::unordered_map<DataType, int> labelIds;
+    const bool withHistograms;
+};
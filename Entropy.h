@@ -9,6 +9,7 @@
 #include "Labels.h"
 
 #include "Huffman.h"
+#include "Rans.h"
 
 /// Calculate entropy of a sequence of symbols
 template <typename T, typename CounterType = int>
@@ -145,6 +146,84 @@ struct LabelDataEntropy<std::string> {
 };
 
 
+/// Estimate the size of DAG pointers coded as deltas to the referencing node
+/**
+ * In a Top DAG, children are created before their parents, so a pointer from node
+ * `from` to node `to` always goes backwards, and most of them do not go far.
+ * Instead of coding the target IDs, code the delta `from - to` (>= 1) with one of:
+ * - Elias-gamma or Elias-delta codes,
+ * - Elias-Fano coding of the (monotone) prefix sums of the deltas,
+ * - Huffman codes for the delta's bucket floor(log2(delta)), followed by the
+ *   delta's bits below the leading one, uncoded.
+ */
+struct PointerDeltaEntropy {
+    PointerDeltaEntropy() : numPointers(0), deltaSum(0), gammaBits(0), deltaBits(0), offsetBits(0), buckets() {}
+
+    /// add a pointer to the statistics
+    /// \param from the node ID of the node that contains the pointer
+    /// \param to the target node ID
+    void addPointer(const int from, const int to) {
+        assert(to < from);
+        const unsigned long long delta = from - to;
+        const unsigned int bucket = log2_floor_template(delta);
+        ++numPointers;
+        deltaSum += delta;
+        gammaBits += 2 * bucket + 1;
+        deltaBits += bucket + 2 * log2_floor_template(bucket + 1) + 1;
+        offsetBits += bucket;
+        buckets.addItem(bucket);
+    }
+
+    /// Construct the bucket Huffman code. Call this after adding all pointers.
+    void construct() {
+        if (numPointers > 0) buckets.construct();
+    }
+
+    /// Size in bits with Elias-gamma coded deltas
+    long long getBitsGamma() const {
+        return gammaBits;
+    }
+
+    /// Size in bits with Elias-delta coded deltas
+    long long getBitsDelta() const {
+        return deltaBits;
+    }
+
+    /// Size in bits with Elias-Fano coding of the deltas' prefix sums, including
+    /// universe and number of elements as 64-bit ints
+    long long getBitsEliasFano() const {
+        if (numPointers == 0) return 0;
+        const unsigned int lowBits = (deltaSum > numPointers) ? log2_floor_template(deltaSum / numPointers) : 0;
+        // lower bits verbatim, upper bits as unary-coded gaps in a bitvector
+        return numPointers * lowBits + (deltaSum >> lowBits) + numPointers + 2 * 64;
+    }
+
+    /// Size in bits with Huffman-coded buckets and uncoded offsets within the buckets
+    long long getBitsBucketHuffman() const {
+        if (numPointers == 0) return 0;
+        return buckets.getBitsNeeded() + buckets.getBitsForTableLabels() + offsetBits;
+    }
+
+    /// Size in bits of the smallest of the delta encodings
+    long long getBitsBest() const {
+        return std::min(std::min(getBitsGamma(), getBitsDelta()), std::min(getBitsEliasFano(), getBitsBucketHuffman()));
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const PointerDeltaEntropy &entropy) {
+        return os << entropy.numPointers << " deltas, avg "
+                  << (entropy.numPointers == 0 ? 0.0 : (entropy.deltaSum * 1.0) / entropy.numPointers)
+                  << "; gamma " << entropy.getBitsGamma() << " bits, delta " << entropy.getBitsDelta()
+                  << " bits, Elias-Fano " << entropy.getBitsEliasFano() << " bits, Huffman buckets "
+                  << entropy.getBitsBucketHuffman() << " bits";
+    }
+
+    unsigned long long numPointers;
+    unsigned long long deltaSum;
+    long long gammaBits, deltaBits, offsetBits;
+    HuffmanBuilder<int> buckets;
+};
+
+
 enum NodeEncoding { IMPLICIT, MISSING };
 
 /// Calculate the different entropies of a TopDag - its structure, its merge types, and its labels
@@ -155,10 +234,14 @@ struct DagEntropy {
         dagPointerEntropy(),
         mergeEntropy(),
         labelDataEntropy(labels),
+        pointerDeltaEntropy(),
+        dagStructureAns(),
+        dagPointerAns(),
+        mergeAns(),
         writer(writer),
-        dagStructureWriter(dagStructureEntropy.huffman, writer),
+        dagStructureWriter(dagStructureEntropy.coder, writer),
         dagPointerWriter(dagPointerEntropy, writer),
-        mergeWriter(mergeEntropy.huffman, writer),
+        mergeWriter(mergeEntropy.coder, writer),
         labelWriter(labelDataEntropy.huffman, writer),
         dag(dag)
     {}
@@ -177,8 +260,10 @@ struct DagEntropy {
             assert(nodeId >= 0);
             if (isLeafOrPointer(nodeId)) {
                 dagStructureEntropy.addItem(MISSING);
+                dagStructureAns.addItem(MISSING);
             } else {
                 dagStructureEntropy.addItem(IMPLICIT);
+                dagStructureAns.addItem(IMPLICIT);
             }
         });
 
@@ -203,6 +288,7 @@ struct DagEntropy {
 
             // We need to code the merge type regardless of the nature of the children
             mergeEntropy.addItem((char)dag.nodes[nodeId].mergeType);
+            mergeAns.addItem((char)dag.nodes[nodeId].mergeType);
 
             // if both children are leaves / pointers, they don't need to be coded in the structure
             if (!isLeafOrPointer(node.left) || !isLeafOrPointer(node.right)) {
@@ -212,9 +298,13 @@ struct DagEntropy {
 
             if (isLeafOrPointer(node.left)) {
                 dagPointerEntropy.addItem(node.left);
+                dagPointerAns.addItem(node.left);
+                pointerDeltaEntropy.addPointer(nodeId, node.left);
             }
             if (isLeafOrPointer(node.right)) {
                 dagPointerEntropy.addItem(node.right);
+                dagPointerAns.addItem(node.right);
+                pointerDeltaEntropy.addPointer(nodeId, node.right);
             }
 
             alreadyVisited[node.left] = true;
@@ -223,10 +313,17 @@ struct DagEntropy {
 
         dagStructureEntropy.flushQueue();
         mergeEntropy.flushQueue();
-        dagStructureEntropy.huffman.construct();
+        dagStructureAns.flushQueue();
+        mergeAns.flushQueue();
+        dagStructureEntropy.coder.construct();
         dagPointerEntropy.construct();
-        mergeEntropy.huffman.construct();
+        mergeEntropy.coder.construct();
         labelDataEntropy.construct();
+        pointerDeltaEntropy.construct();
+        dagStructureAns.coder.construct();
+        dagPointerAns.construct();
+        mergeAns.coder.construct();
+        assert(!global_debug || (dagStructureAns.coder.verify() && dagPointerAns.verify() && mergeAns.coder.verify()));
     }
 
     /// Write the stuff to huffman writers
@@ -295,18 +392,23 @@ struct DagEntropy {
         writer.write();
     }
 
-    /// Retrieve total size for a Huffman-based encoding of the Top DAG
-    long long getTotalSize() const {
+    /// Size of the Huffman-coded pointer target IDs, including the table
+    long long getPointerSizeHuffman() const {
         // Code dag pointers as fixed-length ints
         // Size can be deduced from decoded dag structure data
         long long bits_per_pointer = log2(dag.nodes.size());
+        return dagPointerEntropy.getBitsNeeded() + dagPointerEntropy.getNumSymbols() * bits_per_pointer;
+    }
+
+    /// Retrieve total size for a Huffman-based encoding of the Top DAG
+    long long getTotalSize() const {
         long long bits =
             // node IDs are implicit, but we need to encode the blocked huffman's table (it's quite small)
-            dagStructureEntropy.huffman.getBitsNeeded() + dagStructureEntropy.huffman.getBitsForTableLabels() +
+            dagStructureEntropy.coder.getBitsNeeded() + dagStructureEntropy.coder.getBitsForTableLabels() +
             // pointers are not implicit, need to store them
-            dagPointerEntropy.getBitsNeeded() + dagPointerEntropy.getNumSymbols() * bits_per_pointer +
+            getPointerSizeHuffman() +
             // merge type needs a mapping as well (it's tiny anyway)
-            mergeEntropy.huffman.getBitsNeeded() + mergeEntropy.huffman.getBitsForTableLabels() +
+            mergeEntropy.coder.getBitsNeeded() + mergeEntropy.coder.getBitsForTableLabels() +
             // label strings do need a kind of a table
             labelDataEntropy.huffman.getBitsNeeded() + labelDataEntropy.getExtraSize() +
             // lengths of each data segment, except for the last, as 32 bit ints
@@ -317,10 +419,37 @@ struct DagEntropy {
         return bits;
     }
 
+    /// Retrieve total size for a Huffman-based encoding of the Top DAG, where the pointers are
+    /// coded with whichever of the target ID or delta encodings is smallest
+    long long getTotalSizeBestPointers() const {
+        return getTotalSize() - getPointerSizeHuffman() + std::min(getPointerSizeHuffman(), pointerDeltaEntropy.getBitsBest());
+    }
+
+    /// Retrieve total size for an encoding of the Top DAG that uses rANS for the DAG structure,
+    /// pointers and merge types (and Huffman for the label strings, like getTotalSize())
+    long long getTotalSizeAns() const {
+        long long bits_per_pointer = log2(dag.nodes.size());
+        long long bits =
+            dagStructureAns.coder.getBitsNeeded() + dagStructureAns.coder.getBitsForTable() + dagStructureAns.coder.getBitsForTableLabels() +
+            // pointer values as fixed-length ints, like in getTotalSize()
+            dagPointerAns.getBitsNeeded() + dagPointerAns.getBitsForTable() + dagPointerAns.getNumSymbols() * bits_per_pointer +
+            mergeAns.coder.getBitsNeeded() + mergeAns.coder.getBitsForTable() + mergeAns.coder.getBitsForTableLabels() +
+            labelDataEntropy.huffman.getBitsNeeded() + labelDataEntropy.getExtraSize() +
+            // lengths of each data segment, except for the last, as 32 bit ints
+            4*sizeof(int)*8;
+        return bits;
+    }
+
     HuffmanBlocker<bool, uint8_t, 1, 8> dagStructureEntropy;
     HuffmanBuilder<int> dagPointerEntropy;
     HuffmanBlocker<char, uint16_t, 4, 16> mergeEntropy;
     LabelDataEntropy<DataType> labelDataEntropy;
+    PointerDeltaEntropy pointerDeltaEntropy;
+
+    // rANS coders for the same (blocked) streams
+    HuffmanBlocker<bool, uint8_t, 1, 8, RansCoder<uint8_t>> dagStructureAns;
+    RansCoder<int> dagPointerAns;
+    HuffmanBlocker<char, uint16_t, 4, 16, RansCoder<uint16_t>> mergeAns;
 
     BitWriter &writer;
     BlockedHuffmanWriter<bool, uint8_t, 1, 8> dagStructureWriter;
@@ -9,8 +9,12 @@
 /// UNFINISHED Top DAG writer. Don't use.
 class FileWriter {
 public:
+    /// \param ansBits if not NULL, will hold the size of an encoding that uses rANS instead of
+    /// Huffman codes for the DAG structure, pointers and merge types
+    /// \param deltaBits if not NULL, will hold the size of the Huffman-based encoding where the DAG
+    /// pointers are coded as deltas if that is smaller
     template <typename DataType>
-    static long long write(const TopDag<DataType> &dag, const Labels<DataType> &labels, const std::string &fn, const bool verbose = true) {
+    static long long write(const TopDag<DataType> &dag, const Labels<DataType> &labels, const std::string &fn, const bool verbose = true, long long *ansBits = NULL, long long *deltaBits = NULL) {
         Timer timer;
 
         BitWriter writer(fn);
@@ -18,11 +22,18 @@ public:
         entropy.calculate();
 
         if (verbose) std::cout
-             << "DAG Structure: " << entropy.dagStructureEntropy.huffman << endl
+             << "DAG Structure: " << entropy.dagStructureEntropy.coder << endl
              << "DAG Pointers:  " << entropy.dagPointerEntropy << endl
-             << "Merge Types:   " << entropy.mergeEntropy.huffman << endl
+             << "Ptr deltas:    " << entropy.pointerDeltaEntropy << endl
+             << "Merge Types:   " << entropy.mergeEntropy.coder << endl
              << "Label strings: " << entropy.labelDataEntropy.huffman << " + " << entropy.labelDataEntropy.getExtraSize() << " bits for symbols" << endl
-             << "Huffman calcuation took " << timer.getAndReset() << "ms; " << endl;
+             << "rANS Structure: " << entropy.dagStructureAns.coder << endl
+             << "rANS Pointers:  " << entropy.dagPointerAns << endl
+             << "rANS Merges:    " << entropy.mergeAns.coder << endl
+             << "Huffman and rANS calcuation took " << timer.getAndReset() << "ms; " << endl;
+
+        if (ansBits != NULL) *ansBits = entropy.getTotalSizeAns();
+        if (deltaBits != NULL) *deltaBits = entropy.getTotalSizeBestPointers();
 
         //entropy.write();
         writer.close();
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Hardware event counts of a phase
+struct CounterValues {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t llcMisses;
+    uint64_t branchMisses;
+
+    CounterValues() : cycles(0), instructions(0), llcMisses(0), branchMisses(0) {}
+
+    CounterValues &operator+=(const CounterValues &other) {
+        cycles += other.cycles;
+        instructions += other.instructions;
+        llcMisses += other.llcMisses;
+        branchMisses += other.branchMisses;
+        return *this;
+    }
+
+    CounterValues operator-(const CounterValues &other) const {
+        CounterValues result(*this);
+        result.cycles -= other.cycles;
+        result.instructions -= other.instructions;
+        result.llcMisses -= other.llcMisses;
+        result.branchMisses -= other.branchMisses;
+        return result;
+    }
+
+    /// element-wise minimum, in-place
+    void min(const CounterValues &other) {
+        cycles = std::min(cycles, other.cycles);
+        instructions = std::min(instructions, other.instructions);
+        llcMisses = std::min(llcMisses, other.llcMisses);
+        branchMisses = std::min(branchMisses, other.branchMisses);
+    }
+
+    /// element-wise maximum, in-place
+    void max(const CounterValues &other) {
+        cycles = std::max(cycles, other.cycles);
+        instructions = std::max(instructions, other.instructions);
+        llcMisses = std::max(llcMisses, other.llcMisses);
+        branchMisses = std::max(branchMisses, other.branchMisses);
+    }
+
+    void divide(const int factor) {
+        cycles /= factor;
+        instructions /= factor;
+        llcMisses /= factor;
+        branchMisses /= factor;
+    }
+
+    /// Dump the counts to an output stream (tab-separated values)
+    void dump(std::ostream &os) const {
+        os << cycles << "\t" << instructions << "\t" << llcMisses << "\t" << branchMisses;
+    }
+
+    /// Write a header for dump() (tab-separated), each column name starting with `phase`
+    static void dumpHeader(std::ostream &os, const std::string &phase) {
+        os << phase << "Cycles" << "\t" << phase << "Instructions" << "\t"
+           << phase << "LLCMisses" << "\t" << phase << "BranchMisses";
+    }
+
+    /// Instructions per cycle
+    double ipc() const {
+        return cycles == 0 ? 0.0 : (instructions * 1.0) / cycles;
+    }
+};
+
+/// The calling thread's hardware event counters (Linux perf_event)
+/**
+ * Counting is off unless enabled with setEnabled(), and costs nothing then.
+ * Otherwise every thread opens its counters the first time it uses them.
+ * Counters that can't be opened (no PMU, e.g. in a VM, insufficient
+ * permissions, or not Linux) read as zero; a warning is printed once.
+ */
+class HardwareCounters {
+public:
+    static void setEnabled(const bool enable) {
+        enabled() = enable;
+    }
+
+    static bool isEnabled() {
+        return enabled();
+    }
+
+    /// The calling thread's counters
+    static HardwareCounters &local() {
+        static thread_local HardwareCounters counters;
+        return counters;
+    }
+
+    /// Whether any of the counters could be opened
+    bool available() const {
+        for (const int fd : fds) {
+            if (fd >= 0) return true;
+        }
+        return false;
+    }
+
+    /// Read the counts since the counters were opened
+    CounterValues read() const {
+        CounterValues values;
+        values.cycles = readCounter(fds[0]);
+        values.instructions = readCounter(fds[1]);
+        values.llcMisses = readCounter(fds[2]);
+        values.branchMisses = readCounter(fds[3]);
+        return values;
+    }
+
+    ~HardwareCounters() {
+#ifdef __linux__
+        for (const int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+
+protected:
+    HardwareCounters() : fds{-1, -1, -1, -1} {
+#ifdef __linux__
+        const uint64_t events[numCounters] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                              PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        int error(0);
+        for (int i = 0; i < numCounters; ++i) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = events[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            // this thread, any CPU
+            fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+            if (fds[i] < 0) error = errno;
+        }
+        if (error != 0) warn(strerror(error));
+#else
+        warn("not supported on this platform");
+#endif
+    }
+
+    /// Read a counter, scaled up if the kernel multiplexed it
+    static uint64_t readCounter(const int fd) {
+#ifdef __linux__
+        uint64_t data[3]; // value, time enabled, time running
+        if (fd < 0 || ::read(fd, data, sizeof(data)) != sizeof(data)) return 0;
+        if (data[2] == 0) return 0;
+        return data[2] < data[1] ? (uint64_t)(data[0] * ((double)data[1] / data[2])) : data[0];
+#else
+        (void)fd;
+        return 0;
+#endif
+    }
+
+    static void warn(const char *reason) {
+        static std::once_flag warned;
+        std::call_once(warned, [reason]() {
+            std::cerr << "Some hardware counters are not available (" << reason << "), they will read as 0" << std::endl;
+        });
+    }
+
+    static std::atomic<bool> &enabled() {
+        static std::atomic<bool> flag(false);
+        return flag;
+    }
+
+    static const int numCounters = 4;
+    int fds[numCounters];
+};
+
+/// Attributes the calling thread's hardware events to consecutive phases
+/**
+ * Usage: create before the first phase, and call next() after each phase
+ * with the values to add the phase's counts to. Does nothing unless
+ * HardwareCounters are enabled.
+ */
+class PhaseCounters {
+public:
+    PhaseCounters() : counters(HardwareCounters::isEnabled() ? &HardwareCounters::local() : nullptr), last() {
+        if (counters != nullptr) last = counters->read();
+    }
+
+    /// End a phase
+    /// \param values where to add the counts since the last phase ended (may be NULL)
+    void next(CounterValues *values) {
+        if (counters == nullptr) return;
+        const CounterValues now = counters->read();
+        if (values != NULL) *values += now - last;
+        last = now;
+    }
+
+protected:
+    const HardwareCounters *counters;
+    CounterValues last;
+};
@@ -1,11 +1,11 @@
 #pragma once
 
 #include <cassert>
-#include <iterator>
+#include <cstdint>
 #include <iostream>
 #include <queue>
 #include <sstream>
-#include <unordered_map>
+#include <type_traits>
 #include <vector>
 
 #include "BitWriter.h"
@@ -38,21 +38,56 @@ struct HuffInnerNode : public HuffNode {
         rightId(rightId) {}
 };
 
+/// A Huffman code word, packed into an integer. The code's first bit is the
+/// most significant of the `length` least significant bits of `code`.
+struct HuffCode {
+    uint64_t code;
+    uint8_t length;
+
+    HuffCode() : code(0), length(0) {}
+    HuffCode(const uint64_t code, const uint8_t length) : code(code), length(length) {}
+
+    /// Get the i-th bit of the code word, counting from the first
+    bool operator[](const unsigned int i) const {
+        assert(i < length);
+        return (code >> (length - 1 - i)) & 1;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const HuffCode &code) {
+        for (unsigned int i = 0; i < code.length; ++i) {
+            os << code[i];
+        }
+        return os;
+    }
+};
+
 /// Generic Huffman Code Builder. Only constructs code, does not en-/decode.
+/**
+ * Symbols must be of an integral type. They are remapped to dense IDs through
+ * a lookup table indexed by the (unsigned) symbol value, so symbols should be
+ * reasonably small non-negative numbers (characters, blocked bits, node IDs).
+ */
 template <typename SymbolType>
 class HuffmanBuilder {
+    static_assert(std::is_integral<SymbolType>::value, "HuffmanBuilder requires integral symbols");
+    typedef typename std::make_unsigned<SymbolType>::type IndexType;
+
 public:
-    typedef std::vector<bool> HuffCode;
-    HuffmanBuilder() : numItems(0), symbols(), frequencies(), codes(), nodes() {}
+    HuffmanBuilder() : numItems(0), symbolIds(), symbols(), frequencies(), codes(), nodes() {}
 
     /// add an occurence to the frequency statistics
     void addItem(const SymbolType &symbol) {
-        auto pos = symbols.find(symbol);
-        if (pos == symbols.end()) {
-            pos = symbols.insert(typename std::unordered_map<SymbolType, int>::value_type(symbol, (int)symbols.size())).first;
+        const size_t index = (IndexType)symbol;
+        if (index >= symbolIds.size()) {
+            symbolIds.resize(index + 1, -1);
+        }
+        int &id = symbolIds[index];
+        if (id < 0) {
+            id = (int)symbols.size();
+            symbols.push_back(symbol);
             frequencies.push_back(0);
         }
-        frequencies[pos->second]++;
+        frequencies[id]++;
         ++numItems;
     }
 
@@ -68,7 +103,7 @@ public:
     void construct() {
         codes.resize(frequencies.size());
         constructTree();
-        computeCodes(nodes.size() - 1, HuffCode());
+        computeCodes(nodes.size() - 1, 0, 0);
 
         // Delete the nodes, we don't need them any more
         for (uint i = 0; i < nodes.size(); ++i) {
@@ -88,16 +123,21 @@ public:
         return numItems;
     }
 
+    /// Get the dense ID of a symbol (its index into the code table)
+    int getSymbolId(const SymbolType &symbol) const {
+        assert((size_t)(IndexType)symbol < symbolIds.size());
+        return symbolIds[(IndexType)symbol];
+    }
+
     /// Get the code for a symbol. Must to have called construct() before.
-    HuffCode getCode(const SymbolType &symbol) {
-        assert(symbols[symbol] < (SymbolType) codes.size());
-        return codes[symbols[symbol]];
+    const HuffCode &getCode(const SymbolType &symbol) const {
+        assert(getSymbolId(symbol) >= 0 && getSymbolId(symbol) < (int)codes.size());
+        return codes[getSymbolId(symbol)];
     }
 
     /// Get the length of a symbol's code. Need to have called construct() before.
     int getCodeLength(const SymbolType &symbol) const {
-        assert(symbols[symbol] < codes.size());
-        return codes[symbols[symbol]].size();
+        return getCode(symbol).length;
     }
 
     /// Get the number of bits needed to encode the occurrences encountered with the
@@ -107,7 +147,7 @@ public:
         long long bits(0);
         assert(frequencies.size() == codes.size());
         for (uint i = 0; i < frequencies.size(); ++i) {
-            bits += frequencies[i] * codes[i].size();
+            bits += (long long)frequencies[i] * codes[i].length;
         }
         // For each inner node, store whether left and right children are inner nodes or leaves
         // As we're dealing with a binary tree, this suffices.
@@ -122,11 +162,11 @@ public:
         long long bits(0);
         size_t maxLen(0);
         for (uint i = 0; i < codes.size(); ++i) {
-            maxLen = (codes[i].size() > maxLen) ? codes[i].size() : maxLen;
+            maxLen = (codes[i].length > maxLen) ? codes[i].length : maxLen;
         }
         bits += 2*log2ceil(maxLen) + 1; // code maxLen using gamma coding
         for (uint i = 0; i < codes.size(); ++i) {
-            auto number = maxLen - codes[i].size();
+            auto number = maxLen - codes[i].length;
             bits += number + 1; // code in unary
         }
         return bits;
@@ -143,12 +183,11 @@ public:
     std::string toString() const {
         std::stringstream os;
         os << "Huffman with " << frequencies.size() << " symbols:" << std::endl;
-        for (auto it = symbols.cbegin(); it != symbols.cend(); ++it) {
-            os << +it->first << ": ";
-            std::copy(codes[it->second].cbegin(), codes[it->second].cend(), std::ostream_iterator<bool>(os));
-            os << " (" << codes[it->second].size() << "b)"
-               << " frequency " << frequencies[it->second]
-               << " (" << (frequencies[it->second] * 100.0) / numItems  << "%)"
+        for (uint id = 0; id < symbols.size(); ++id) {
+            os << +symbols[id] << ": " << codes[id]
+               << " (" << +codes[id].length << "b)"
+               << " frequency " << frequencies[id]
+               << " (" << (frequencies[id] * 100.0) / numItems  << "%)"
                << std::endl;
         }
         return os.str();
@@ -182,21 +221,26 @@ protected:
     }
 
     /// Recursively assign codes to the symbols
-    void computeCodes(const int nodeId, HuffCode prefix) {
+    /// \param nodeId the Huffman tree node to assign codes to
+    /// \param prefix the code of the path leading to the node
+    /// \param length the length of that path
+    void computeCodes(const int nodeId, const uint64_t prefix, const uint8_t length) {
         const HuffNode *node(nodes[nodeId]);
         if (const HuffLeaf *leaf = dynamic_cast<const HuffLeaf*>(node)) {
-            codes[leaf->symbolId] = std::move(prefix);
+            codes[leaf->symbolId] = HuffCode(prefix, length);
         } else if (const HuffInnerNode *innerNode = dynamic_cast<const HuffInnerNode*>(node)) {
-            prefix.push_back(false);
-            computeCodes(innerNode->leftId, prefix);
-
-            prefix.back() = true;
-            computeCodes(innerNode->rightId, prefix);
+            // frequencies are ints, so codes can't get anywhere near this long
+            assert(length < 64);
+            computeCodes(innerNode->leftId, prefix << 1, length + 1);
+            computeCodes(innerNode->rightId, (prefix << 1) | 1, length + 1);
         }
     }
 
     int numItems;
-    std::unordered_map<SymbolType, int> symbols;
+    /// Dense remapping of symbols to IDs, indexed by symbol value. -1 for symbols not seen.
+    std::vector<int> symbolIds;
+    /// The symbols by ID
+    std::vector<SymbolType> symbols;
     std::vector<int> frequencies;
     std::vector<HuffCode> codes;
     std::vector<HuffNode*> nodes;
@@ -205,13 +249,16 @@ protected:
 /// Constructs a blocked Huffman coding
 /**
  * Constructs a blocked Huffman coding for the given input distribution.
+ * Other entropy coders with the same addItem() interface as HuffmanBuilder
+ * (e.g. RansCoder) can be plugged in via CoderType.
  *
  * The size of the output type must be a multiple of the input type's!
  */
-template <typename InputType, typename OutputType, int inputSize = sizeof(InputType)*8, int outputSize = sizeof(OutputType)*8>
+template <typename InputType, typename OutputType, int inputSize = sizeof(InputType)*8, int outputSize = sizeof(OutputType)*8,
+          typename CoderType = HuffmanBuilder<OutputType>>
 struct HuffmanBlocker {
     /// Initialise Huffman blocker
-    HuffmanBlocker() : blockingFactor(outputSize / inputSize), tempStore(), huffman() {
+    HuffmanBlocker() : blockingFactor(outputSize / inputSize), tempStore(), coder() {
         assert(outputSize % inputSize == 0);
         tempStore.reserve(blockingFactor);
     }
@@ -250,13 +297,13 @@ struct HuffmanBlocker {
             if (verbose) std::cout << (uint) tempStore[i] << " ";
         }
         if (verbose) std::cout << " => " << (uint)result << std::endl;
-        huffman.addItem(result);
+        coder.addItem(result);
         tempStore.clear();
     }
 
     const uint blockingFactor;
     std::vector<InputType> tempStore;
-    HuffmanBuilder<OutputType> huffman;
+    CoderType coder;
 };
 
 /// Unfinished Huffman code writer
@@ -267,12 +314,13 @@ public:
 
     void write(const SymbolType &sym) {
         std::cout << "HW: Writing " << (int) sym << std::endl;
-        writer.writeBits(huffman.getCode(sym));
+        const HuffCode &code(huffman.getCode(sym));
+        writer.writeBits(code.code, code.length);
     }
 
     void addItem(const SymbolType &sym) {
-        const std::vector<bool> &vec(huffman.getCode(sym));
-        buffer.insert(buffer.end(), vec.begin(), vec.end());
+        const HuffCode &code(huffman.getCode(sym));
+        buffer.append(code.code, code.length);
     }
 
     template <typename InputIterator>
@@ -291,7 +339,7 @@ public:
 protected:
     HuffmanBuilder<SymbolType> &huffman;
     BitWriter &writer;
-    std::vector<bool> buffer;
+    BitBuffer buffer;
 };
 
 /// Unfinished writer for blocked Huffman codes
@@ -331,13 +379,17 @@ public:
 
 protected:
     void flushTempStore() {
+        // pad like HuffmanBlocker::flushQueue() does, so that the codes match
+        while (tempStore.size() < blockingFactor) {
+            tempStore.push_back(InputType{});
+        }
         // move into huffman
         OutputType result{};
         for (uint i = 0; i < blockingFactor; ++i) {
             result |= (tempStore[i] << (i * inputSize));
         }
-        const std::vector<bool> &vec(huffman.getCode(result));
-        buffer.insert(buffer.end(), vec.begin(), vec.end());
+        const HuffCode &code(huffman.getCode(result));
+        buffer.append(code.code, code.length);
         tempStore.clear();
     }
 
@@ -345,5 +397,5 @@ protected:
     BitWriter &writer;
     const uint blockingFactor;
     std::vector<InputType> tempStore;
-    std::vector<bool> buffer;
+    BitBuffer buffer;
 };
@@ -117,7 +117,12 @@ struct Labels : LabelsT<Value> {
         if (id >= keys.size()) {
             keys.resize(id + 1);
         }
+        keys[id] = insert(value);
+    }
 
+    /// Add a value without assigning it to an ID (if it isn't there yet)
+    /// \returns the value's index in valueIndex
+    int insert(const Value &value) {
         // The idea for this is from the following anonymous StackOverflow post:
         // http://stackoverflow.com/a/2562117
         auto it = values.find(value);
@@ -125,8 +130,7 @@ struct Labels : LabelsT<Value> {
             it = values.insert(std::make_pair(value, (int)values.size())).first;
             valueIndex.push_back(&it->first);
         }
-
-        keys[id] = it->second;
+        return it->second;
     }
 
     uint size() const {
@@ -0,0 +1,433 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BitWriter.h"
+#include "Common.h"
+#include "Nodes.h"
+#include "TopDag.h"
+
+/// On-disk Top DAG layout
+/**
+ * All sections are arrays of 64-bit words, bit arrays are packed MSB first
+ * (like BitBuffer). The file consists of
+ * - the header (see DagFileHeader)
+ * - a bitvector marking the leaves, one bit per node (node 0 is the dummy and not a leaf)
+ * - rank samples for the leaf bitvector: the number of leaves before each block of
+ *   `rankBlockBits` bits
+ * - the inner nodes in ID order, as fixed-width (left, right, mergeType + 1) tuples
+ * - the leaves in ID order, as fixed-width indices into the label dictionary
+ * - the label dictionary: offsets of every distinct label into the label data (plus
+ *   the end offset), followed by the label data.
+ *
+ * Node `i` is the `rank1(i)`-th leaf if it is a leaf, and the `(i - rank1(i) - 1)`-th
+ * inner node otherwise, so each node access touches a constant number of pages.
+ */
+struct DagFileHeader {
+    static const uint64_t expectedMagic = 0x3130474144504f54ull; // "TOPDAG01"
+    static const uint64_t rankBlockBits = 512;
+
+    uint64_t magic;
+    uint64_t numNodes;
+    uint64_t numLeaves;
+    uint64_t numLabels;
+    uint64_t pointerBits;
+    uint64_t labelBits;
+    /// Section offsets in words from the start of the file
+    uint64_t leafOffset, rankOffset, innerOffset, labelIdOffset, labelOffsetsOffset, labelDataOffset;
+    /// Total file size in words
+    uint64_t numWords;
+};
+
+/// Helpers for reading the packed arrays of a DAG file
+struct DagFileBits {
+    /// Read `length` bits starting at bit `pos` from an MSB-first packed word array
+    static uint64_t read(const uint64_t *words, const uint64_t pos, const unsigned int length) {
+        if (length == 0) return 0;
+        const uint64_t word = pos / 64;
+        const unsigned int offset = pos % 64;
+        const uint64_t mask = (length == 64) ? ~0ull : ((1ull << length) - 1);
+        if (offset + length <= 64) {
+            return (words[word] >> (64 - offset - length)) & mask;
+        }
+        const unsigned int rest = offset + length - 64;
+        return ((words[word] << rest) | (words[word + 1] >> (64 - rest))) & mask;
+    }
+
+    /// Number of set bits before position `pos` of a bitvector with rank samples
+    static uint64_t rank1(const uint64_t *bits, const uint64_t *samples, const uint64_t pos) {
+        const uint64_t wordsPerBlock = DagFileHeader::rankBlockBits / 64;
+        const uint64_t word = pos / 64;
+        uint64_t rank = samples[pos / DagFileHeader::rankBlockBits];
+        for (uint64_t w = word - word % wordsPerBlock; w < word; ++w) {
+            rank += __builtin_popcountll(bits[w]);
+        }
+        if (pos % 64 > 0) {
+            rank += __builtin_popcountll(bits[word] >> (64 - pos % 64));
+        }
+        return rank;
+    }
+};
+
+/// Convert labels to their on-disk representation and back (empty template for overloading)
+template <typename DataType, typename Enable = void>
+struct DagLabelSerialiser {};
+
+/// String labels are stored verbatim
+template <>
+struct DagLabelSerialiser<std::string> {
+    static void append(const std::string &label, std::string &out) {
+        out += label;
+    }
+    static bool isValidLength(const size_t) {
+        return true;
+    }
+    static std::string read(const char *data, const size_t length) {
+        return std::string(data, length);
+    }
+};
+
+/// Arithmetic labels are stored as their raw bytes
+template <typename DataType>
+struct DagLabelSerialiser<DataType, typename std::enable_if<std::is_arithmetic<DataType>::value>::type> {
+    static void append(const DataType &label, std::string &out) {
+        out.append(reinterpret_cast<const char *>(&label), sizeof(DataType));
+    }
+    static bool isValidLength(const size_t length) {
+        return length == sizeof(DataType);
+    }
+    static DataType read(const char *data, const size_t length) {
+        assert(length == sizeof(DataType));
+        (void)length;
+        DataType label;
+        memcpy(&label, data, sizeof(DataType));
+        return label;
+    }
+};
+
+/// Write a Top DAG in the format read by MappedTopDag
+template <typename DataType>
+struct DagFileWriter {
+    /// Write a Top DAG to a file
+    /// \param dag the Top DAG to write
+    /// \param filename output filename (path must exist)
+    /// \returns whether the file could be written
+    static bool write(const TopDag<DataType> &dag, const std::string &filename) {
+        const uint64_t numNodes = dag.nodes.size();
+        DagFileHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = DagFileHeader::expectedMagic;
+        header.numNodes = numNodes;
+        header.pointerBits = log2ceil(numNodes);
+
+        // Deduplicate the labels and collect the leaves and inner nodes
+        std::unordered_map<DataType, uint64_t> labelIds;
+        std::vector<const DataType *> labels;
+        std::vector<uint64_t> leafLabels;
+        BitBuffer leaves, inner;
+        for (uint64_t nodeId = 0; nodeId < numNodes; ++nodeId) {
+            const DagNode<DataType> &node = dag.nodes[nodeId];
+            const bool isLeaf = nodeId > 0 && node.left < 0;
+            leaves.append(isLeaf, 1);
+            if (isLeaf) {
+                assert(node.label != NULL);
+                auto it = labelIds.emplace(*node.label, labels.size());
+                if (it.second) labels.push_back(node.label);
+                leafLabels.push_back(it.first->second);
+            } else if (nodeId > 0) {
+                assert(node.left > 0 && node.right > 0);
+                inner.append(node.left, header.pointerBits);
+                inner.append(node.right, header.pointerBits);
+                inner.append(node.mergeType + 1, 3);
+            }
+        }
+        header.numLeaves = leafLabels.size();
+        header.numLabels = labels.size();
+        header.labelBits = log2ceil(header.numLabels);
+
+        BitBuffer leafLabelBits;
+        for (const uint64_t label : leafLabels) {
+            leafLabelBits.append(label, header.labelBits);
+        }
+
+        // Rank samples for the leaf bitvector
+        const uint64_t wordsPerBlock = DagFileHeader::rankBlockBits / 64;
+        std::vector<uint64_t> rankSamples;
+        uint64_t rank(0);
+        for (uint64_t word = 0; word < leaves.words.size(); ++word) {
+            if (word % wordsPerBlock == 0) rankSamples.push_back(rank);
+            rank += __builtin_popcountll(leaves.words[word]);
+        }
+        if (rankSamples.empty()) rankSamples.push_back(0);
+
+        // Label dictionary
+        std::string labelData;
+        std::vector<uint64_t> labelOffsets;
+        for (const DataType *label : labels) {
+            labelOffsets.push_back(labelData.size());
+            DagLabelSerialiser<DataType>::append(*label, labelData);
+        }
+        labelOffsets.push_back(labelData.size());
+        labelData.resize(((labelData.size() + 7) / 8) * 8, '\0');
+
+        // Lay out the sections
+        header.leafOffset = (sizeof(header) + 7) / 8;
+        header.rankOffset = header.leafOffset + leaves.words.size();
+        header.innerOffset = header.rankOffset + rankSamples.size();
+        header.labelIdOffset = header.innerOffset + inner.words.size() + 1;
+        header.labelOffsetsOffset = header.labelIdOffset + leafLabelBits.words.size() + 1;
+        header.labelDataOffset = header.labelOffsetsOffset + labelOffsets.size();
+        header.numWords = header.labelDataOffset + labelData.size() / 8;
+
+        std::ofstream out(filename.c_str(), std::ios::binary | std::ios::out);
+        if (!out.is_open()) return false;
+        const uint64_t padding(0);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        writeWords(out, leaves.words);
+        writeWords(out, rankSamples);
+        // pad the packed arrays by a word so that reads never go past the section
+        writeWords(out, inner.words);
+        out.write(reinterpret_cast<const char *>(&padding), sizeof(padding));
+        writeWords(out, leafLabelBits.words);
+        out.write(reinterpret_cast<const char *>(&padding), sizeof(padding));
+        writeWords(out, labelOffsets);
+        out.write(labelData.data(), labelData.size());
+        return out.good();
+    }
+
+protected:
+    static void writeWords(std::ofstream &out, const std::vector<uint64_t> &words) {
+        out.write(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(uint64_t));
+    }
+};
+
+/// A read-only Top DAG backed by a memory-mapped file written by DagFileWriter
+/**
+ * Provides the same `nodes[i]` / `nodes.size()` interface as TopDag, so it can be
+ * used with Navigator. Nodes are decoded on access, the label dictionary is
+ * decoded when the file is opened, so that concurrent readers need no locking.
+ */
+template <typename DataType>
+class MappedTopDag {
+public:
+    /// Node accessor that decodes nodes from the mapped file
+    class NodeAccessor {
+    public:
+        NodeAccessor(const MappedTopDag &dag) : dag(dag) {}
+
+        DagNode<DataType> operator[](const int nodeId) const {
+            return dag.getNode(nodeId);
+        }
+
+        size_t size() const {
+            return dag.header == NULL ? 0 : dag.header->numNodes;
+        }
+
+    protected:
+        const MappedTopDag &dag;
+    };
+
+    MappedTopDag() : nodes(*this), data(NULL), length(0), header(NULL), labels() {}
+
+    /// Map a DAG file into memory
+    /// \param filename the file to map
+    MappedTopDag(const std::string &filename) : MappedTopDag() {
+        open(filename);
+    }
+
+    MappedTopDag(const MappedTopDag &) = delete;
+    MappedTopDag &operator=(const MappedTopDag &) = delete;
+
+    ~MappedTopDag() {
+        close();
+    }
+
+    /// Map a DAG file into memory
+    /// \param filename the file to map
+    /// \returns whether the file could be mapped and is a DAG file with a valid layout and valid nodes
+    bool open(const std::string &filename) {
+        close();
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(DagFileHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) return false;
+        // Navigation jumps around, don't read ahead
+        madvise(mapped, st.st_size, MADV_RANDOM);
+
+        data = static_cast<const uint64_t *>(mapped);
+        length = st.st_size;
+        header = reinterpret_cast<const DagFileHeader *>(data);
+        if (header->magic != DagFileHeader::expectedMagic || header->numWords * 8 != length ||
+            !isValidLayout(*header) || !readLabels() || !isValidNodes()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /// Check that a header's sections are in order, within the file, and large enough
+    /// for its numbers of nodes, leaves and labels, so that decoding stays within the file
+    static bool isValidLayout(const DagFileHeader &header) {
+        const uint64_t headerWords = (sizeof(header) + 7) / 8;
+        if (header.leafOffset < headerWords || header.rankOffset < header.leafOffset ||
+            header.innerOffset < header.rankOffset || header.labelIdOffset <= header.innerOffset ||
+            header.labelOffsetsOffset <= header.labelIdOffset || header.labelDataOffset < header.labelOffsetsOffset ||
+            header.numWords < header.labelDataOffset) {
+            return false;
+        }
+        // node IDs are ints, and node 0 is the dummy
+        if (header.numNodes == 0 || header.numNodes > (uint64_t)std::numeric_limits<int>::max() ||
+            header.numLeaves >= header.numNodes || header.numLabels > header.numLeaves ||
+            (header.numLeaves > 0 && header.numLabels == 0) ||
+            header.pointerBits != log2ceil(header.numNodes) || header.labelBits != log2ceil(header.numLabels)) {
+            return false;
+        }
+        const uint64_t numInner = header.numNodes - header.numLeaves - 1;
+        const uint64_t numRankSamples = (header.numNodes - 1) / DagFileHeader::rankBlockBits + 1;
+        // the packed arrays are padded by a word (see DagFileWriter)
+        return header.numNodes <= (header.rankOffset - header.leafOffset) * 64 &&
+               numRankSamples <= header.innerOffset - header.rankOffset &&
+               numInner * (2 * header.pointerBits + 3) <= (header.labelIdOffset - header.innerOffset - 1) * 64 &&
+               header.numLeaves * header.labelBits <= (header.labelOffsetsOffset - header.labelIdOffset - 1) * 64 &&
+               header.numLabels < header.labelDataOffset - header.labelOffsetsOffset; // plus the end offset
+    }
+
+    /// Unmap the file
+    void close() {
+        if (data != NULL) {
+            munmap(const_cast<uint64_t *>(data), length);
+        }
+        data = NULL;
+        header = NULL;
+        length = 0;
+        labels.clear();
+    }
+
+    bool isOpen() const {
+        return data != NULL;
+    }
+
+    /// Decode a node. Negative IDs yield an empty node.
+    /// Needs no checks beyond the node ID, as open() validated every node.
+    DagNode<DataType> getNode(const int nodeId) const {
+        assert(isOpen() && nodeId < (int)header->numNodes);
+        if (nodeId <= 0) {
+            return DagNode<DataType>(nodeId == 0 ? -2 : -1, nodeId == 0 ? -2 : -1, NULL, NO_MERGE);
+        }
+        const uint64_t leafRank = DagFileBits::rank1(data + header->leafOffset, data + header->rankOffset, nodeId);
+        if (DagFileBits::read(data + header->leafOffset, nodeId, 1)) {
+            const uint64_t labelId = DagFileBits::read(data + header->labelIdOffset, leafRank * header->labelBits, header->labelBits);
+            return DagNode<DataType>(-1, -1, getLabel(labelId), NO_MERGE);
+        }
+        const unsigned int pointerBits = header->pointerBits;
+        const uint64_t pos = (nodeId - leafRank - 1) * (2 * pointerBits + 3);
+        const uint64_t *inner = data + header->innerOffset;
+        return DagNode<DataType>((int)DagFileBits::read(inner, pos, pointerBits),
+                                 (int)DagFileBits::read(inner, pos + pointerBits, pointerBits),
+                                 NULL,
+                                 (MergeType)((int)DagFileBits::read(inner, pos + 2 * pointerBits, 3) - 1));
+    }
+
+    /// Get the size of the mapped file in bytes
+    size_t getFileSize() const {
+        return length;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const MappedTopDag &dag) {
+        if (!dag.isOpen()) return os << "Mapped Top DAG (not open)";
+        return os << "Mapped Top DAG with " << dag.header->numNodes - 1 << " nodes (" << dag.header->numLeaves
+                  << " leaves, " << dag.header->numLabels << " distinct labels) in " << dag.length << " bytes";
+    }
+
+    NodeAccessor nodes;
+
+protected:
+    /// Get a label from the decoded dictionary. Labels stay valid until the file is closed.
+    const DataType *getLabel(const uint64_t labelId) const {
+        assert(labelId < labels.size());
+        return &labels[labelId];
+    }
+
+    /// Decode the label dictionary
+    /// \returns whether the label offsets are non-decreasing and within the label data
+    bool readLabels() {
+        const uint64_t *offsets = data + header->labelOffsetsOffset;
+        const char *labelData = reinterpret_cast<const char *>(data + header->labelDataOffset);
+        const uint64_t labelDataBytes = (header->numWords - header->labelDataOffset) * 8;
+        labels.reserve(header->numLabels);
+        for (uint64_t labelId = 0; labelId < header->numLabels; ++labelId) {
+            const uint64_t begin = offsets[labelId], end = offsets[labelId + 1];
+            if (end < begin || end > labelDataBytes || !DagLabelSerialiser<DataType>::isValidLength(end - begin)) {
+                return false;
+            }
+            labels.push_back(DagLabelSerialiser<DataType>::read(labelData + begin, end - begin));
+        }
+        return true;
+    }
+
+    /// Check every node once, so that getNode() can decode any node ID below numNodes:
+    /// the leaf bitvector and its rank samples must agree with numLeaves, leaves must
+    /// refer to existing labels, and inner nodes must have a valid merge type and
+    /// point to nodes with smaller IDs (so the DAG is acyclic)
+    bool isValidNodes() const {
+        const uint64_t *leafBits = data + header->leafOffset;
+        const uint64_t *rankSamples = data + header->rankOffset;
+        const uint64_t *inner = data + header->innerOffset;
+        const uint64_t *labelIds = data + header->labelIdOffset;
+        const unsigned int pointerBits = header->pointerBits;
+        const uint64_t numInner = header->numNodes - header->numLeaves - 1;
+        // node 0 is the dummy and not a leaf
+        if (DagFileBits::read(leafBits, 0, 1)) return false;
+        uint64_t leafRank(0), innerRank(0);
+        for (uint64_t nodeId = 1; nodeId < header->numNodes; ++nodeId) {
+            if (nodeId % DagFileHeader::rankBlockBits == 0 &&
+                rankSamples[nodeId / DagFileHeader::rankBlockBits] != leafRank) {
+                return false;
+            }
+            if (DagFileBits::read(leafBits, nodeId, 1)) {
+                if (leafRank == header->numLeaves ||
+                    DagFileBits::read(labelIds, leafRank * header->labelBits, header->labelBits) >= header->numLabels) {
+                    return false;
+                }
+                ++leafRank;
+                continue;
+            }
+            if (innerRank == numInner) return false;
+            const uint64_t pos = innerRank++ * (2 * pointerBits + 3);
+            const uint64_t left = DagFileBits::read(inner, pos, pointerBits);
+            const uint64_t right = DagFileBits::read(inner, pos + pointerBits, pointerBits);
+            const int mergeType = (int)DagFileBits::read(inner, pos + 2 * pointerBits, 3) - 1;
+            if (left == 0 || left >= nodeId || right == 0 || right >= nodeId || mergeType < VERT_WITH_BBN ||
+                mergeType > HORZ_NO_BBN) {
+                return false;
+            }
+        }
+        return leafRank == header->numLeaves && rankSamples[0] == 0;
+    }
+
+    const uint64_t *data;
+    size_t length;
+    const DagFileHeader *header;
+    /// the decoded label dictionary
+    std::vector<DataType> labels;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+/// Memory usage of a phase
+struct MemoryValues {
+    /// the most heap memory held at once during the phase, beyond what was held when it started (bytes)
+    uint64_t peakBytes;
+    /// number of heap allocations during the phase
+    uint64_t allocations;
+    /// resident set size of the process when the phase ended (bytes)
+    uint64_t residentBytes;
+
+    MemoryValues() : peakBytes(0), allocations(0), residentBytes(0) {}
+
+    MemoryValues &operator+=(const MemoryValues &other) {
+        peakBytes += other.peakBytes;
+        allocations += other.allocations;
+        residentBytes += other.residentBytes;
+        return *this;
+    }
+
+    /// element-wise minimum, in-place
+    void min(const MemoryValues &other) {
+        peakBytes = std::min(peakBytes, other.peakBytes);
+        allocations = std::min(allocations, other.allocations);
+        residentBytes = std::min(residentBytes, other.residentBytes);
+    }
+
+    /// element-wise maximum, in-place
+    void max(const MemoryValues &other) {
+        peakBytes = std::max(peakBytes, other.peakBytes);
+        allocations = std::max(allocations, other.allocations);
+        residentBytes = std::max(residentBytes, other.residentBytes);
+    }
+
+    void divide(const int factor) {
+        peakBytes /= factor;
+        allocations /= factor;
+        residentBytes /= factor;
+    }
+
+    /// Dump the values to an output stream (tab-separated values)
+    void dump(std::ostream &os) const {
+        os << peakBytes << "\t" << allocations << "\t" << residentBytes;
+    }
+
+    /// Write a header for dump() (tab-separated), each column name starting with `phase`
+    static void dumpHeader(std::ostream &os, const std::string &phase) {
+        os << phase << "PeakBytes" << "\t" << phase << "Allocations" << "\t" << phase << "ResidentBytes";
+    }
+};
+
+/// The calling thread's heap allocations, maintained by the hook in AllocationHook.h
+struct AllocationCounts {
+    /// bytes allocated minus bytes freed by this thread (negative if it frees other threads' memory)
+    int64_t current;
+    /// the maximum of `current` since the last reset
+    int64_t peak;
+    /// number of allocations
+    uint64_t count;
+
+    /// The calling thread's counts
+    static AllocationCounts &local() {
+        // trivially constructible, so this needs no initialisation guard inside operator new
+        static thread_local AllocationCounts counts;
+        return counts;
+    }
+
+    void allocated(const size_t bytes) {
+        current += bytes;
+        peak = std::max(peak, current);
+        ++count;
+    }
+
+    void freed(const size_t bytes) {
+        current -= bytes;
+    }
+};
+
+/// Memory accounting switch and resident set sampling
+/**
+ * Per-phase accounting is off unless enabled with setEnabled(). Allocations
+ * are only counted in programs that include AllocationHook.h (exactly once),
+ * otherwise they read as zero and only the resident set size is measured.
+ */
+class MemoryUsage {
+public:
+    static void setEnabled(const bool enable) {
+        enabled() = enable;
+    }
+
+    static bool isEnabled() {
+        return enabled();
+    }
+
+    /// The process's current resident set size in bytes (0 if unknown)
+    static uint64_t residentBytes() {
+#ifdef __linux__
+        std::ifstream statm("/proc/self/statm");
+        uint64_t size(0), resident(0);
+        if (statm >> size >> resident) {
+            return resident * sysconf(_SC_PAGESIZE);
+        }
+#endif
+        return 0;
+    }
+
+protected:
+    static std::atomic<bool> &enabled() {
+        static std::atomic<bool> flag(false);
+        return flag;
+    }
+};
+
+/// Attributes the calling thread's heap usage to consecutive phases
+/**
+ * Usage: create before the first phase, and call next() after each phase
+ * with the values to add the phase's usage to. Does nothing unless
+ * MemoryUsage is enabled. Phases must not be nested, as each one resets the
+ * thread's peak.
+ */
+class PhaseMemory {
+public:
+    PhaseMemory() : enabled(MemoryUsage::isEnabled()), start(0), count(0) {
+        if (enabled) begin();
+    }
+
+    /// End a phase and start the next one
+    /// \param values where to add the usage since the last phase ended (may be NULL)
+    void next(MemoryValues *values) {
+        if (!enabled) return;
+        if (values != NULL) {
+            const AllocationCounts &counts = AllocationCounts::local();
+            values->peakBytes += std::max<int64_t>(0, counts.peak - start);
+            values->allocations += counts.count - count;
+            values->residentBytes += MemoryUsage::residentBytes();
+        }
+        begin();
+    }
+
+protected:
+    void begin() {
+        AllocationCounts &counts = AllocationCounts::local();
+        counts.peak = counts.current;
+        start = counts.current;
+        count = counts.count;
+    }
+
+    const bool enabled;
+    int64_t start;
+    uint64_t count;
+};
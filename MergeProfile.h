@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// What happened in one iteration of top tree construction
+struct IterationProfile {
+    int iteration;
+    /// number of merges in the horizontal and vertical phases
+    uint64_t horizontalMerges, verticalMerges;
+    /// live nodes and edges after the iteration
+    uint64_t numNodes, numEdges;
+    /// node slots in use, including those of nodes that were merged away
+    uint64_t nodeSlots;
+    /// edge slots in use (up to the first free one) and allocated
+    uint64_t edgeSlots, edgeCapacity;
+    /// new DAG nodes, i.e., merges that weren't found in the DAG already
+    uint64_t dagNodesAdded;
+    /// time spent in the phases (ms). Compaction is only done by RePairCombiner.
+    double horizontalTime, compactTime, verticalTime;
+    /// approximate memory used by the tree and the DAG after the iteration (bytes)
+    uint64_t treeBytes, dagBytes;
+
+    IterationProfile()
+        : iteration(0), horizontalMerges(0), verticalMerges(0), numNodes(0), numEdges(0), nodeSlots(0), edgeSlots(0),
+          edgeCapacity(0), dagNodesAdded(0), horizontalTime(0), compactTime(0), verticalTime(0), treeBytes(0),
+          dagBytes(0) {}
+
+    /// Fill in the sizes of a construction's tree and DAG
+    template <typename TreeType, typename DagType>
+    void recordSizes(const TreeType &tree, const DagType &dag) {
+        // the live nodes form a tree
+        numNodes = tree._numEdges + 1;
+        numEdges = tree._numEdges;
+        nodeSlots = tree._numNodes;
+        edgeSlots = tree._firstFreeEdge;
+        edgeCapacity = tree.edges.capacity();
+        treeBytes = tree.nodes.capacity() * sizeof(tree.nodes[0]) + tree.edges.capacity() * sizeof(tree.edges[0]);
+        dagBytes = dag.approximateBytes();
+    }
+
+    /// Fraction of the edge slots in use that hold live edges
+    double edgeFill() const {
+        return edgeSlots == 0 ? 0.0 : (numEdges * 1.0) / edgeSlots;
+    }
+
+    /// Fraction of the merges that were already in the DAG
+    double hashHitRate() const {
+        const uint64_t merges = horizontalMerges + verticalMerges;
+        return merges == 0 ? 0.0 : 1.0 - (dagNodesAdded * 1.0) / merges;
+    }
+};
+
+/// Per-iteration records of a top tree construction, exportable as CSV or JSON
+/**
+ * Pass one to TopDagConstructor::setProfile() or RePairCombiner::setProfile()
+ * before constructing. experiments/plot.py can graph the output.
+ */
+struct MergeProfile {
+    std::vector<IterationProfile> iterations;
+
+    void writeCSV(std::ostream &os) const {
+        os << "iteration,horizontalMerges,verticalMerges,numNodes,numEdges,nodeSlots,edgeSlots,edgeCapacity,edgeFill,"
+           << "dagNodesAdded,hashHitRate,horizontalTime,compactTime,verticalTime,treeBytes,dagBytes" << std::endl;
+        for (const IterationProfile &it : iterations) {
+            os << it.iteration << "," << it.horizontalMerges << "," << it.verticalMerges << "," << it.numNodes << ","
+               << it.numEdges << "," << it.nodeSlots << "," << it.edgeSlots << "," << it.edgeCapacity << "," << it.edgeFill() << ","
+               << it.dagNodesAdded << "," << it.hashHitRate() << "," << it.horizontalTime << "," << it.compactTime
+               << "," << it.verticalTime << "," << it.treeBytes << "," << it.dagBytes << std::endl;
+        }
+    }
+
+    void writeJSON(std::ostream &os) const {
+        os << "{\"iterations\": [";
+        for (size_t i = 0; i < iterations.size(); ++i) {
+            const IterationProfile &it = iterations[i];
+            os << (i == 0 ? "" : ",") << std::endl
+               << "  {\"iteration\": " << it.iteration << ", \"horizontalMerges\": " << it.horizontalMerges
+               << ", \"verticalMerges\": " << it.verticalMerges << ", \"numNodes\": " << it.numNodes
+               << ", \"numEdges\": " << it.numEdges << ", \"nodeSlots\": " << it.nodeSlots
+               << ", \"edgeSlots\": " << it.edgeSlots
+               << ", \"edgeCapacity\": " << it.edgeCapacity << ", \"edgeFill\": " << it.edgeFill()
+               << ", \"dagNodesAdded\": " << it.dagNodesAdded << ", \"hashHitRate\": " << it.hashHitRate()
+               << ", \"horizontalTime\": " << it.horizontalTime << ", \"compactTime\": " << it.compactTime
+               << ", \"verticalTime\": " << it.verticalTime << ", \"treeBytes\": " << it.treeBytes
+               << ", \"dagBytes\": " << it.dagBytes << "}";
+        }
+        os << std::endl << "]}" << std::endl;
+    }
+
+    /// Write to a file, as JSON if its name ends in ".json" and as CSV otherwise
+    /// \returns whether the file could be written
+    bool write(const std::string &filename) const {
+        std::ofstream out(filename.c_str());
+        if (!out.is_open()) return false;
+        const bool json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+        if (json) {
+            writeJSON(out);
+        } else {
+            writeCSV(out);
+        }
+        return out.good();
+    }
+};
@@ -2,26 +2,30 @@
 
 #include <iostream>
 
+#include "BufferedWriter.h"
 #include "Navigation.h"
 #include "TopDag.h"
 
-/// Traverse an in-memory Top DAG in preorder
-template <typename DataType>
+/// Traverse a Top DAG in preorder
+template <typename DataType, typename DAGType = TopDag<DataType>>
 class PreorderTraversal {
 public:
-    PreorderTraversal(const TopDag<DataType> &dag, const bool print=false) : nav(dag), print(print) {}
+    /// \param dag the Top DAG to traverse
+    /// \param print whether to write the traversed tree as XML
+    /// \param out stream to write the XML representation to
+    PreorderTraversal(const DAGType &dag, const bool print=false, std::ostream &out=std::cout) : nav(dag), print(print), writer(out) {}
 
     /// Do the traversal and print an XML representation to stdout
     std::pair<unsigned long long, unsigned long long> run() {
         openTag(0);
-        auto visited = traverse(0);
+        auto visited = traverse(false);
         return std::make_pair(visited, nav.getMaxTreeStackSize());
     }
 
-    /// Do the traversal and print an XML representation to stdout
+    /// Do a right-to-left traversal and print an XML representation to stdout
     std::pair<unsigned long long, unsigned long long> runRight() {
         openTag(0);
-        auto visited = traverseRight(0);
+        auto visited = traverse(true);
         return std::make_pair(visited, nav.getMaxTreeStackSize());
     }
 
@@ -29,69 +33,58 @@ protected:
     /// Output an opening tag
     void openTag(int depth=0, const bool newline=true) {
         if (!print) return;
-        for (int i = 0; i < depth; ++i) cout << " ";
-        std::cout << "<" << *nav.getLabel() << ">";
-        if (newline) std::cout << std::endl;
+        writer.fill(' ', depth);
+        writer << '<' << *nav.getLabel() << '>';
+        if (newline) writer << '\n';
     }
 
     /// Output a closing tag
     void closeTag(int depth=0, const bool indent=true) {
         if (!print) return;
-        if (indent) for (int i = 0; i < depth; ++i) cout << " ";
-        std::cout << "</" << *nav.getLabel() << ">" << std::endl;
+        if (indent) writer.fill(' ', depth);
+        writer << "</" << *nav.getLabel() << ">\n";
     }
 
-    /// Recursively traverse
-    unsigned long long traverse(int depth=0) {
+    /// Traverse the whole tree (iteratively, so arbitrarily deep or large
+    /// trees don't overflow the call stack)
+    /// \param rightFirst whether to visit children from right to left
+    unsigned long long traverse(const bool rightFirst) {
         unsigned long long visited = 0;
-        if (!nav.isLeaf()) {
-            nav.firstChild();
-            ++visited;
-            openTag(++depth, !nav.isLeaf());
-        } else {
-            closeTag(depth, !nav.isLeaf());
-            if (nav.nextSibling()) {
+        int depth = 0;
+        while (true) {
+            if (!nav.isLeaf()) {
+                if (rightFirst) nav.lastChild(); else nav.firstChild();
                 ++visited;
-                openTag(depth, !nav.isLeaf());
+                openTag(++depth, !nav.isLeaf());
             } else {
-                while (!nav.nextSibling()) {
-                    bool hasParent = nav.parent();
-                    if (depth > 0) closeTag(--depth);
-                    if (!hasParent) return visited;
+                // we're on a leaf, so the closing tag follows the opening one on the same line
+                closeTag(depth, false);
+                if (nextSibling(rightFirst)) {
+                    ++visited;
+                    openTag(depth, !nav.isLeaf());
+                } else {
+                    while (!nextSibling(rightFirst)) {
+                        bool hasParent = nav.parent();
+                        if (depth > 0) closeTag(--depth);
+                        if (!hasParent) {
+                            writer.flush();
+                            return visited;
+                        }
+                    }
+                    ++visited;
+                    openTag(depth);
                 }
-                ++visited;
-                openTag(depth);
             }
         }
-        return visited + traverse(depth);
     }
 
-    /// Recursively traverse
-    size_t traverseRight(int depth=0) {
-        size_t visited = 0;
-        if (!nav.isLeaf()) {
-            nav.lastChild();
-            ++visited;
-            openTag(++depth, !nav.isLeaf());
-        } else {
-            closeTag(depth, !nav.isLeaf());
-            if (nav.prevSibling()) {
-                ++visited;
-                openTag(depth, !nav.isLeaf());
-            } else {
-                while (!nav.prevSibling()) {
-                    bool hasParent = nav.parent();
-                    if (depth > 0) closeTag(--depth);
-                    if (!hasParent) return visited;
-                }
-                ++visited;
-                openTag(depth);
-            }
-        }
-        return visited + traverseRight(depth);
+    /// Move to the next sibling in traversal order
+    bool nextSibling(const bool rightFirst) {
+        return rightFirst ? nav.prevSibling() : nav.nextSibling();
     }
 
 protected:
-    Navigator<DataType> nav;
+    Navigator<DataType, DAGType> nav;
     const bool print;
+    BufferedWriter writer;
 };
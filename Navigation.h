@@ -1,8 +1,9 @@
 #pragma once
 
 #include <cassert>
-#include <stack>
+#include <vector>
 
+#include "DagSummary.h"
 #include "TopDag.h"
 
 /// Represents an entry in the DAG stack
@@ -23,22 +24,29 @@ struct NavigationRecord {
     }
 };
 
-/// Navigate around in an in-memory Top DAG
-template <typename DataType>
+/// Navigate around in a Top DAG
+/**
+ * DAGType can be any Top DAG representation that provides `nodes[i]` and
+ * `nodes.size()`, like the in-memory TopDag or a file-backed MappedTopDag.
+ */
+template <typename DataType, typename DAGType = TopDag<DataType>>
 class Navigator {
 public:
-    using DAGType = TopDag<DataType>;
-    using DStackT = std::stack<NavigationRecord>;
-    using TStackT = std::deque<DStackT>;
+    using SummaryType = DagSummaries<DataType, DAGType>;
 
     /// Create a new navigator for the given Top DAG
-    Navigator(const DAGType &dag): dag(dag), dagStack(), treeStack(), maxTreeStackSize(0) {
+    /// \param dag the Top DAG to navigate in
+    /// \param summaries optional cluster summaries of `dag`, required for childAt()
+    /// and the subtree queries
+    Navigator(const DAGType &dag, const SummaryType *summaries = NULL)
+        : dag(dag), summaries(summaries), records(), levels(), maxTreeStackSize(0) {
         if (verbose) std::cout << dag << std::endl;
 
+        levels.emplace_back(0, 0);
         int nodeId = -1;
         int nextNode = (int)dag.nodes.size() - 1;
         while (nextNode > 0) {
-            dagStack.emplace(NavigationRecord{nextNode, nodeId, true});
+            records.emplace_back(nextNode, nodeId, true);
             nodeId = nextNode;
             nextNode = dag.nodes[nodeId].left;
         }
@@ -46,27 +54,27 @@ public:
 
     /// Retrieve the current node's label
     const DataType* getLabel() const {
-        return dag.nodes[dagStack.top().nodeId].label;
+        return dag.nodes[records.back().nodeId].label;
     }
 
     /// Move to the current node's parent
     /// \returns whether the operation completed successfully (i.e. if the
     /// current node had a parent)
     bool parent() {
-        if (treeStack.empty()) {
+        if (levels.size() == 1) {
             return false;
         } else {
-            dagStack = treeStack.back();
-            treeStack.pop_back();
+            records.resize(levels.back().segmentStart);
+            levels.pop_back();
             return true;
         }
     }
 
     /// Check whether the current node is a leaf in the tree
     bool isLeaf() const {
-        DStackT stack(dagStack);
-        while (!stack.empty()) {
-            NavigationRecord &record = stack.top();
+        size_t level = levels.size() - 1;
+        for (size_t pos = getDagStackSize(); pos-- > 0;) {
+            const NavigationRecord &record = recordAt(level, pos);
             MergeType mergeType = dag.nodes[record.parentId].mergeType;
 
             if ((!record.left && (mergeType == VERT_NO_BBN ||
@@ -83,7 +91,6 @@ public:
                 // vertical merge from the left/top
                 return false;
             }
-            stack.pop();
         }
         assert(false);
         return false;
@@ -96,25 +103,18 @@ public:
         if (isLeaf()) {
             return false;
         }
-        treeStack.push_back(dagStack);
+        const size_t pos = findVerticalFromLeft();
+        size_t level = levels.size() - 1;
+        auto nodeId(recordAt(level, pos).parentId), nextNode(dag.nodes[nodeId].right);
+        // the child's DAG stack shares everything below `pos` with ours
+        levels.emplace_back(pos, records.size());
         maxTreeStackSize = std::max(maxTreeStackSize, getTreeStackSize());
-        while (!dagStack.empty()) {
-            NavigationRecord &record = dagStack.top();
-            MergeType mergeType = dag.nodes[record.parentId].mergeType;
-
-            if (record.left && (mergeType == VERT_WITH_BBN || mergeType == VERT_NO_BBN)) {
-                break;
-            }
-            dagStack.pop();
-        }
-        auto nodeId(dagStack.top().parentId), nextNode(dag.nodes[nodeId].right);
-        dagStack.pop();
-        dagStack.emplace(NavigationRecord{nextNode, nodeId, false});
-        if (verbose) std::cout << "fC: pushing " << dagStack.top() << std::endl;
+        records.emplace_back(nextNode, nodeId, false);
+        if (verbose) std::cout << "fC: pushing " << records.back() << std::endl;
 
         while ((nodeId = nextNode) > 0 && (nextNode = dag.nodes[nextNode].left) > 0) {
-            dagStack.emplace(NavigationRecord{nextNode, nodeId, true});
-            if (verbose) std::cout << "fC: pushing " << dagStack.top() << std::endl;
+            records.emplace_back(nextNode, nodeId, true);
+            if (verbose) std::cout << "fC: pushing " << records.back() << std::endl;
         }
         return true;
     }
@@ -126,25 +126,16 @@ public:
         if (isLeaf()) {
             return false;
         }
-        treeStack.push_back(dagStack);
-        maxTreeStackSize = std::max(maxTreeStackSize, getTreeStackSize());
-
-        while (!dagStack.empty()) {
-            NavigationRecord &record = dagStack.top();
-            MergeType mergeType = dag.nodes[record.parentId].mergeType;
-
-            if (record.left && (mergeType == VERT_WITH_BBN || mergeType == VERT_NO_BBN)) {
-                break;
-            }
-            dagStack.pop();
-        }
-        auto nodeId(dagStack.top().parentId), nextNode(dag.nodes[nodeId].right);
+        const size_t pos = findVerticalFromLeft();
+        size_t level = levels.size() - 1;
+        auto nodeId(recordAt(level, pos).parentId), nextNode(dag.nodes[nodeId].right);
         bool wentLeft = false;
-        dagStack.pop();
+        levels.emplace_back(pos, records.size());
+        maxTreeStackSize = std::max(maxTreeStackSize, getTreeStackSize());
 
         while (nextNode > 0) {
-            dagStack.emplace(NavigationRecord{nextNode, nodeId, wentLeft});
-            if (verbose) std::cout << "lC: pushing " << dagStack.top() << std::endl;
+            records.emplace_back(nextNode, nodeId, wentLeft);
+            if (verbose) std::cout << "lC: pushing " << records.back() << std::endl;
             nodeId = nextNode;
             auto mergeType = dag.nodes[nextNode].mergeType;
             if (mergeType == VERT_WITH_BBN || mergeType == VERT_NO_BBN) {
@@ -164,9 +155,9 @@ public:
     bool nextSibling() {
         if (verbose) dumpDagStack();
 
-        DStackT stack(dagStack);
-        while (!stack.empty()) {
-            NavigationRecord &record = stack.top();
+        size_t level = levels.size() - 1, pos = getDagStackSize();
+        while (pos-- > 0) {
+            const NavigationRecord &record = recordAt(level, pos);
             MergeType mergeType = dag.nodes[record.parentId].mergeType;
             if (record.left && (mergeType == HORZ_LEFT_BBN ||
                                 mergeType == HORZ_RIGHT_BBN ||
@@ -178,23 +169,21 @@ public:
                 // a or b from right => abort
                 return false;
             }
-            stack.pop();
         }
 
         // No more next siblings in the tree, we've exhausted the stack
-        if (stack.empty()) {
+        if (pos == (size_t)-1) {
             return false;
         }
-        dagStack = stack;
 
-        auto nodeId(dagStack.top().parentId), nextNode(dag.nodes[nodeId].right);
-        dagStack.pop();
-        dagStack.emplace(NavigationRecord{nextNode, nodeId, false});
-        if (verbose) std::cout << "nS: pushing " << dagStack.top() << std::endl;
+        auto nodeId(recordAt(level, pos).parentId), nextNode(dag.nodes[nodeId].right);
+        truncateDagStack(pos);
+        records.emplace_back(nextNode, nodeId, false);
+        if (verbose) std::cout << "nS: pushing " << records.back() << std::endl;
 
         while ((nodeId = nextNode) > 0 && (nextNode = dag.nodes[nextNode].left) > 0) {
-            dagStack.emplace(NavigationRecord{nextNode, nodeId, true});
-            if (verbose) std::cout << "nS: pushing " << dagStack.top() << std::endl;
+            records.emplace_back(nextNode, nodeId, true);
+            if (verbose) std::cout << "nS: pushing " << records.back() << std::endl;
         }
         return true;
     }
@@ -205,9 +194,9 @@ public:
     bool prevSibling() {
         if (verbose) dumpDagStack();
 
-        DStackT stack(dagStack);
-        while (!stack.empty()) {
-            NavigationRecord &record = stack.top();
+        size_t level = levels.size() - 1, pos = getDagStackSize();
+        while (pos-- > 0) {
+            const NavigationRecord &record = recordAt(level, pos);
             MergeType mergeType = dag.nodes[record.parentId].mergeType;
             if (!record.left && (mergeType == HORZ_LEFT_BBN ||
                                  mergeType == HORZ_RIGHT_BBN ||
@@ -219,22 +208,20 @@ public:
                 // a or b from right => abort
                 return false;
             }
-            stack.pop();
         }
 
         // No more next siblings in the tree, we've exhausted the stack
-        if (stack.empty()) {
+        if (pos == (size_t)-1) {
             return false;
         }
 
-        dagStack = stack;
-        auto nodeId(dagStack.top().parentId), nextNode(dag.nodes[nodeId].left);
+        auto nodeId(recordAt(level, pos).parentId), nextNode(dag.nodes[nodeId].left);
         bool wentLeft = true;
-        dagStack.pop();
+        truncateDagStack(pos);
 
         while (nextNode > 0) {
-            dagStack.emplace(NavigationRecord{nextNode, nodeId, wentLeft});
-            if (verbose) std::cout << "pS: pushing " << dagStack.top() << std::endl;
+            records.emplace_back(nextNode, nodeId, wentLeft);
+            if (verbose) std::cout << "pS: pushing " << records.back() << std::endl;
             nodeId = nextNode;
             auto mergeType = dag.nodes[nextNode].mergeType;
             if (mergeType == VERT_WITH_BBN || mergeType == VERT_NO_BBN) {
@@ -249,25 +236,119 @@ public:
         return true;
     }
 
+    /// Get the depth of the current node (the root has depth 0)
+    size_t getDepth() const {
+        return levels.size() - 1;
+    }
+
+    /// Get the number of children of the current node (requires summaries)
+    long long getNumChildren() const {
+        assert(summaries != NULL);
+        if (isLeaf()) return 0;
+        size_t level = levels.size() - 1;
+        const int parentId = recordAt(level, findVerticalFromLeft()).parentId;
+        return (*summaries)[dag.nodes[parentId].right].topFanout;
+    }
+
+    /// Move to the current node's k-th child (counting from 0), skipping over the
+    /// clusters containing the other children (requires summaries)
+    /// \returns whether the operation was a success (i.e. the node has more than k children)
+    bool childAt(long long k) {
+        assert(summaries != NULL);
+        if (verbose) dumpDagStack();
+        if (k < 0 || isLeaf()) {
+            return false;
+        }
+        const size_t pos = findVerticalFromLeft();
+        size_t level = levels.size() - 1;
+        auto nodeId(recordAt(level, pos).parentId), nextNode(dag.nodes[nodeId].right);
+        if (k >= (*summaries)[nextNode].topFanout) {
+            return false;
+        }
+        levels.emplace_back(pos, records.size());
+        maxTreeStackSize = std::max(maxTreeStackSize, getTreeStackSize());
+        descendToChild(nodeId, nextNode, k);
+        return true;
+    }
+
+    /// Move to the current node's k-th next sibling (k = 1 is the next sibling),
+    /// skipping over the clusters containing the siblings in between (requires summaries)
+    /// \returns whether the operation was a success (i.e. the node has at least k next siblings)
+    bool nextSibling(long long k) {
+        assert(summaries != NULL);
+        if (verbose) dumpDagStack();
+        if (k <= 0) return k == 0;
+
+        size_t level = levels.size() - 1, pos = getDagStackSize();
+        while (pos-- > 0) {
+            const NavigationRecord &record = recordAt(level, pos);
+            if (record.parentId < 0) return false;
+            const DagNode<DataType> parent = dag.nodes[record.parentId];
+            if (record.left && (parent.mergeType == HORZ_LEFT_BBN ||
+                                parent.mergeType == HORZ_RIGHT_BBN ||
+                                parent.mergeType == HORZ_NO_BBN)) {
+                // the right part holds the next siblings up to here
+                const long long numSiblings = (*summaries)[parent.right].topFanout;
+                if (k <= numSiblings) break;
+                k -= numSiblings;
+            } else if ((!record.left) && (parent.mergeType == VERT_WITH_BBN ||
+                                          parent.mergeType == VERT_NO_BBN)) {
+                return false;
+            }
+        }
+        if (pos == (size_t)-1) {
+            return false;
+        }
+
+        const auto nodeId = recordAt(level, pos).parentId;
+        truncateDagStack(pos);
+        descendToChild(nodeId, dag.nodes[nodeId].right, k - 1);
+        return true;
+    }
+
+    /// Get the number of nodes in the current node's subtree, including the node
+    /// itself (requires summaries)
+    long long getSubtreeSize() const {
+        long long size = 1;
+        forEachSubtreeCluster([&](const int clusterId, const int) {
+            size += (*summaries)[clusterId].numNodes;
+        });
+        return size;
+    }
+
+    /// Get the height of the current node's subtree (0 for a leaf, requires summaries)
+    int getSubtreeHeight() const {
+        int height = 0;
+        forEachSubtreeCluster([&](const int clusterId, const int depth) {
+            height = std::max(height, depth + (*summaries)[clusterId].height);
+        });
+        return height;
+    }
+
+    /// Count the nodes with a given label in the current node's subtree, including the
+    /// node itself (requires summaries with histograms)
+    long long countLabelInSubtree(const DataType &label) const {
+        long long count = (*getLabel() == label);
+        forEachSubtreeCluster([&](const int clusterId, const int) {
+            count += summaries->countLabel(clusterId, label);
+        });
+        return count;
+    }
+
     /// Debug helper to dump the DAG stack
     void dumpDagStack() const {
-        DStackT stack(dagStack);
+        size_t level = levels.size() - 1;
         std::cout << "DagStack: ";
-        while (!stack.empty()) {
-            std::cout << stack.top() << " :: ";
-            stack.pop();
+        for (size_t pos = getDagStackSize(); pos-- > 0;) {
+            std::cout << recordAt(level, pos) << " :: ";
         }
         std::cout << std::endl;
     }
 
-    /// Debug helper to retrieve tree stack size
+    /// Debug helper to retrieve tree stack size, i.e., the memory used to be able to
+    /// return to the current node's ancestors
     unsigned long long getTreeStackSize() const {
-        unsigned long long treeStackSize(0);
-        for (const DStackT &stack : treeStack) {
-            treeStackSize += stack.size();
-        }
-        treeStackSize *= sizeof(DStackT::value_type);
-        return treeStackSize;
+        return levels.back().segmentStart * sizeof(NavigationRecord) + (levels.size() - 1) * sizeof(TreeLevel);
     }
 
     /// Debug helper to return largest tree stack size encountered
@@ -276,9 +357,114 @@ public:
     }
 
 private:
+    /// A tree level's DAG stack consists of the first `prefixLength` records of its
+    /// parent level's DAG stack, followed by `records[segmentStart..)` up to the next
+    /// level's segmentStart (or the end of `records` for the current level)
+    struct TreeLevel {
+        size_t prefixLength;
+        size_t segmentStart;
+        TreeLevel(size_t prefixLength, size_t segmentStart) : prefixLength(prefixLength), segmentStart(segmentStart) {}
+    };
+
+    /// Number of records on the current node's DAG stack
+    size_t getDagStackSize() const {
+        const TreeLevel &current = levels.back();
+        return current.prefixLength + records.size() - current.segmentStart;
+    }
+
+    /// Access the record at position `pos` of the DAG stack of tree level `level`.
+    /// `level` is moved to the level that owns the record, so that walking down
+    /// the stack from the top costs amortised constant time per record.
+    const NavigationRecord &recordAt(size_t &level, const size_t pos) const {
+        while (pos < levels[level].prefixLength) {
+            --level;
+        }
+        return records[levels[level].segmentStart + pos - levels[level].prefixLength];
+    }
+
+    /// Position of the topmost record on the DAG stack that entered a vertical merge from the left
+    size_t findVerticalFromLeft() const {
+        size_t level = levels.size() - 1, pos = getDagStackSize();
+        while (pos-- > 0) {
+            const NavigationRecord &record = recordAt(level, pos);
+            MergeType mergeType = dag.nodes[record.parentId].mergeType;
+            if (record.left && (mergeType == VERT_WITH_BBN || mergeType == VERT_NO_BBN)) {
+                break;
+            }
+        }
+        assert(pos != (size_t)-1);
+        return pos;
+    }
+
+    /// Call `callback(clusterId, depth)` for every cluster that the current node's
+    /// subtree consists of (apart from the node itself), where `depth` is the depth
+    /// of the cluster's top boundary node below the current node. These clusters are
+    /// the lower parts of the vertical merges that the current node and the bottom
+    /// boundary nodes below it were merged in.
+    template <typename Callback>
+    void forEachSubtreeCluster(const Callback &callback) const {
+        assert(summaries != NULL);
+        if (isLeaf()) return;
+        size_t level = levels.size() - 1;
+        int depth = 0;
+        for (size_t pos = findVerticalFromLeft() + 1; pos-- > 0;) {
+            const NavigationRecord &record = recordAt(level, pos);
+            if (record.parentId < 0) break;
+            const DagNode<DataType> parent = dag.nodes[record.parentId];
+            if (parent.mergeType == VERT_WITH_BBN || parent.mergeType == VERT_NO_BBN) {
+                if (!record.left) continue;
+                // we're coming from the upper part, whose bottom boundary node is in our
+                // subtree, so the lower part is entirely in the subtree
+                callback(parent.right, depth);
+                if (parent.mergeType == VERT_NO_BBN) break;
+                depth += (*summaries)[parent.right].boundaryDepth;
+            }
+            // otherwise, the bottom boundary node stays the same
+        }
+    }
+
+    /// Push the records from `nodeId` down through its child `nextNode` to the k-th
+    /// child (counting from 0) of the top boundary node of the cluster `nextNode`
+    void descendToChild(int nodeId, int nextNode, long long k) {
+        bool wentLeft = false;
+        while (nextNode > 0) {
+            records.emplace_back(nextNode, nodeId, wentLeft);
+            if (verbose) std::cout << "cA: pushing " << records.back() << std::endl;
+            nodeId = nextNode;
+            const DagNode<DataType> node = dag.nodes[nextNode];
+            if (node.mergeType == VERT_WITH_BBN || node.mergeType == VERT_NO_BBN) {
+                // all children of the top boundary node are in the upper part
+                nextNode = node.left;
+                wentLeft = true;
+            } else if (node.left > 0 && k >= (*summaries)[node.left].topFanout) {
+                // skip the children in the left part
+                k -= (*summaries)[node.left].topFanout;
+                nextNode = node.right;
+                wentLeft = false;
+            } else {
+                nextNode = node.left;
+                wentLeft = true;
+            }
+        }
+    }
+
+    /// Shrink the current DAG stack to `length` records
+    void truncateDagStack(const size_t length) {
+        TreeLevel &current = levels.back();
+        if (length >= current.prefixLength) {
+            records.resize(current.segmentStart + length - current.prefixLength);
+        } else {
+            current.prefixLength = length;
+            records.resize(current.segmentStart);
+        }
+    }
+
     const DAGType &dag;
-    DStackT dagStack;
-    TStackT treeStack;
+    const SummaryType *summaries;
+    /// The DAG stack segments of all tree levels from the root to the current node
+    std::vector<NavigationRecord> records;
+    /// One entry per tree level on the path from the root to the current node
+    std::vector<TreeLevel> levels;
     unsigned long long maxTreeStackSize;
     static const bool verbose = false;
 };
@@ -10,6 +10,7 @@
 
 #include "Common.h"
 #include "Timer.h"
+#include "Traversal.h"
 
 using std::cout;
 using std::endl;
@@ -317,30 +318,32 @@ public:
         return nodesEqual(other, labels, otherLabels, 0, 0, verbose);
     }
 
-    /// Recursive node comparison helper function used by isEqual(). You should not need to use this directly.
+    /// Node comparison helper function used by isEqual(). You should not need to use this directly.
+    /// Compares the subtrees iteratively, as deep trees would overflow the call stack.
     template <typename LabelType>
     bool nodesEqual(const OrderedTree<NodeType, EdgeType> &other, LabelType &labels, LabelType &otherLabels, const int nodeId, const int otherNodeId, const bool verbose = false) const {
-        const NodeType &node(nodes[nodeId]), &otherNode(other.nodes[otherNodeId]);
-        if (node.numEdges() != otherNode.numEdges()) {
-            if (verbose) cout << "Edge count mismatch at nodes " << nodeId << " and " << otherNodeId << " : " << node.numEdges() << " vs " << otherNode.numEdges() << endl;
-            return false;
-        }
-        if (labels[nodeId] != otherLabels[otherNodeId]) {
-            if (verbose) cout << "Label mismatch at nodes " << nodeId << " and " << otherNodeId << " : '" << labels[nodeId] << "' vs '" << otherLabels[otherNodeId] << "'" << endl;
-            return false;
-        }
-
-        for (int i = 0; i < node.numEdges(); ++i) {
-            const int headId(edges[node.firstEdgeIndex + i].headNode);
-            const int otherHeadId(other.edges[otherNode.firstEdgeIndex + i].headNode);
-            assert(nodes[headId].parent == nodeId);
-            assert(other.nodes[otherHeadId].parent == otherNodeId);
-            if (!nodesEqual(other, labels, otherLabels, headId, otherHeadId)) {
-                if (verbose) cout << "Children no " << i+1 << " of " << node.numEdges() <<" (" << headId << " and " << otherHeadId << ", labels " << labels[headId] << " and " << otherLabels[otherHeadId] << "), parent " << nodeId << " / " << otherNodeId << " did not match, children: " << nodes[headId] << " and " << other.nodes[otherHeadId] << endl;
+        std::vector<std::pair<int, int>> pending(1, std::make_pair(nodeId, otherNodeId));
+        while (!pending.empty()) {
+            const int id(pending.back().first), otherId(pending.back().second);
+            pending.pop_back();
+            const NodeType &node(nodes[id]), &otherNode(other.nodes[otherId]);
+            if (node.numEdges() != otherNode.numEdges()) {
+                if (verbose) cout << "Edge count mismatch at nodes " << id << " and " << otherId << " : " << node.numEdges() << " vs " << otherNode.numEdges() << ", parents " << node.parent << " / " << otherNode.parent << endl;
+                return false;
+            }
+            if (labels[id] != otherLabels[otherId]) {
+                if (verbose) cout << "Label mismatch at nodes " << id << " and " << otherId << " : '" << labels[id] << "' vs '" << otherLabels[otherId] << "', parents " << node.parent << " / " << otherNode.parent << endl;
                 return false;
             }
-        }
 
+            for (int i = node.numEdges(); i-- > 0;) {
+                const int headId(edges[node.firstEdgeIndex + i].headNode);
+                const int otherHeadId(other.edges[otherNode.firstEdgeIndex + i].headNode);
+                assert(nodes[headId].parent == id);
+                assert(other.nodes[otherHeadId].parent == otherId);
+                pending.emplace_back(headId, otherHeadId);
+            }
+        }
         return true;
     }
 
@@ -551,19 +554,21 @@ public:
     /// \param initial inital value for the first folding
     template <typename T, typename Fold, typename Callback>
     const T foldLeftPostOrder(const Callback &callback, const Fold &fold, const T initial) const {
-        return traverseFoldLeftPostOrder(0, callback, fold, initial);
-    }
-
-    /// This does the work for foldLeftPostOrder() and should not be used directly
-    template <typename T, typename Fold, typename Callback>
-    const T traverseFoldLeftPostOrder(const int nodeId, const Callback &callback,
-                                      const Fold &fold, const T initial) const {
-        assert(0 <= nodeId && nodeId < _numNodes);
-        T last(initial);
-        for (const EdgeType *edge = firstEdge(nodeId); edge <= lastEdge(nodeId); ++edge) {
-            last = fold(last, traverseFoldLeftPostOrder(edge->headNode, callback, fold, initial));
-        }
-        return callback(last);
+        // the fold values of the nodes on the current path
+        std::vector<T> values;
+        T result(initial);
+        traverseTree(*this, 0,
+            [&](const int, const int) { values.push_back(initial); },
+            [&](const int, const int) {
+                T value = callback(values.back());
+                values.pop_back();
+                if (values.empty()) {
+                    result = value;
+                } else {
+                    values.back() = fold(values.back(), value);
+                }
+            }, false);
+        return result;
     }
 
     /// Calculate the height of the tree (i.e., the maximum depth of a node).
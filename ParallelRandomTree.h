@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "RandomTree.h"
+#include "WorkStealingPool.h"
+
+/// Generates ordered unlabelled trees uniformly at random using multiple threads
+/**
+ * Works like RandomTreeGenerator, but splits every linear step into chunks
+ * of words that are processed in parallel:
+ * - Each chunk's random words come from its own generator, seeded with a value
+ *   drawn from the shared generator and the chunk's index. The result thus
+ *   doesn't depend on the number of threads. The O(sqrt(n)) corrections to the
+ *   number of opening parentheses are sequential.
+ * - The chunks' excesses and first minima are computed in parallel. A prefix sum
+ *   over the chunks then finds the first position of minimum excess.
+ * - The rotated sequence is written one output word at a time.
+ *
+ * The tree is built by resolving matching parentheses per chunk, see buildTree().
+ */
+template <typename RNG>
+class ParallelRandomTreeGenerator : public RandomTreeGenerator<RNG> {
+    typedef RandomTreeGenerator<RNG> Base;
+    typedef typename Base::RangeExcess RangeExcess;
+
+public:
+    /// Create a parallel random tree generator
+    /// \param gen the random generator to use for seeding
+    /// \param pool the threads to generate with, which can be reused for other work
+    ParallelRandomTreeGenerator(RNG &gen, WorkStealingPool &pool)
+        : Base(gen), pool(pool) {}
+
+    /// Generate a uniformly random balanced parenthesis sequence in the format of
+    /// RandomTreeGenerator::randomBalancedParentheses()
+    void randomBalancedParentheses(vector<uint64_t> &words, const uint64_t numPairs) {
+        const uint64_t length = 2 * numPairs + 1;
+        vector<uint64_t> sequence((length + 63) / 64);
+        const size_t numChunks = (sequence.size() + chunkWords - 1) / chunkWords;
+
+        // Draw random words
+        const uint32_t seed = generator();
+        vector<uint64_t> counts(numChunks, 0);
+        parallelFor(numChunks, [&](const size_t chunk) {
+            std::seed_seq seedSequence{seed, (uint32_t)chunk, (uint32_t)(chunk >> 32)};
+            RNG chunkGenerator(seedSequence);
+            const size_t end = std::min(sequence.size(), (chunk + 1) * chunkWords);
+            for (size_t word = chunk * chunkWords; word < end; ++word) {
+                sequence[word] = ((uint64_t)chunkGenerator() << 32) ^ (uint64_t)chunkGenerator();
+                if (word == sequence.size() - 1 && length % 64 != 0) {
+                    sequence[word] &= ((uint64_t)1 << (length % 64)) - 1;
+                }
+                counts[chunk] += __builtin_popcountll(sequence[word]);
+            }
+        });
+        uint64_t count(0);
+        for (const uint64_t chunkCount : counts) {
+            count += chunkCount;
+        }
+        this->correctCount(sequence, count, numPairs, length);
+
+        // Find the first position of minimum excess
+        vector<RangeExcess> excesses(numChunks);
+        parallelFor(numChunks, [&](const size_t chunk) {
+            excesses[chunk] = Base::rangeExcess(sequence, chunk * chunkWords * 64,
+                                                std::min(length, (chunk + 1) * chunkWords * 64));
+        });
+        int64_t excess(0), minimum(std::numeric_limits<int64_t>::max());
+        uint64_t start(0);
+        for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+            if (excess + excesses[chunk].minimum < minimum) {
+                minimum = excess + excesses[chunk].minimum;
+                start = chunk * chunkWords * 64 + excesses[chunk].minimumPos;
+            }
+            excess += excesses[chunk].excess;
+        }
+        assert(excess == -1 && start >= 1);
+
+        // Rotate the sequence to begin at `start`, leaving out the closing parenthesis before it
+        const uint64_t numBits = 2 * numPairs;
+        words.assign((numBits + 63) / 64, 0);
+        parallelFor((words.size() + chunkWords - 1) / chunkWords, [&](const size_t chunk) {
+            const size_t end = std::min(words.size(), (chunk + 1) * chunkWords);
+            for (size_t word = chunk * chunkWords; word < end; ++word) {
+                const unsigned int numWordBits = std::min<uint64_t>(64, numBits - 64 * word);
+                uint64_t pos = start + 64 * word;
+                if (pos >= length) pos -= length;
+                const unsigned int first = std::min<uint64_t>(numWordBits, length - pos);
+                words[word] = Base::readBits(sequence, pos, first);
+                if (first < numWordBits) {
+                    words[word] |= Base::readBits(sequence, 0, numWordBits - first) << first;
+                }
+            }
+        });
+        assert(Base::isWellFormed(words, numBits));
+    }
+
+    /// Generate an unlabelled ordered tree uniformly at random
+    /// \param tree an empty tree, its nodes are numbered in preorder
+    /// \param numEdges the number of edges that the tree shall have
+    /// \param verbose whether to print the bitstring to stdout
+    template <typename TreeType>
+    void generateTree(TreeType &tree, const int numEdges, const bool verbose = false) {
+        vector<uint64_t> words;
+        randomBalancedParentheses(words, numEdges);
+        if (verbose) {
+            cout << "Bitstring: (";
+            for (uint64_t i = 0; i < 2 * (uint64_t)numEdges; ++i) {
+                cout << (Base::getBit(words, i) ? "(" : ")");
+            }
+            cout << ")" << endl;
+        }
+        buildTree(tree, words, numEdges);
+    }
+
+    /// Build a tree from a balanced parenthesis sequence as produced by randomBalancedParentheses(),
+    /// wrapped in an additional root
+    /**
+     * Nodes are numbered in preorder, and the edges are sorted by tail node like
+     * after OrderedTree::compact(). This takes two parallel passes over the chunks.
+     * The first resolves the parentheses matched within each chunk, and records
+     * how many children the chunk adds to each of the nodes that are open at
+     * its start. A sequential pass over the chunks' unmatched parentheses then
+     * determines these nodes, and every node's number of children. After a
+     * prefix sum over those, the second pass writes the edges.
+     *
+     * \param tree an empty tree
+     * \param words the parentheses (1 = opening)
+     * \param numPairs the number of parenthesis pairs
+     */
+    template <typename TreeType>
+    void buildTree(TreeType &tree, const vector<uint64_t> &words, const uint64_t numPairs) {
+        assert(tree._numNodes == 0);
+        const uint64_t numNodes = numPairs + 1;
+        const uint64_t numBits = 2 * numPairs;
+        const size_t numChunks = (words.size() + chunkWords - 1) / chunkWords;
+        tree.nodes.resize(numNodes);
+        tree.edges.resize(numNodes);
+
+        vector<ChunkState> chunks(numChunks);
+        // The first node of each chunk
+        parallelFor(numChunks, [&](const size_t chunk) {
+            const size_t end = std::min(words.size(), (chunk + 1) * chunkWords);
+            for (size_t word = chunk * chunkWords; word < end; ++word) {
+                chunks[chunk].firstNode += __builtin_popcountll(words[word]);
+            }
+        });
+        uint64_t firstNode(1);
+        for (ChunkState &chunk : chunks) {
+            std::swap(firstNode, chunk.firstNode);
+            firstNode += chunk.firstNode;
+        }
+
+        // First pass: resolve the parentheses within each chunk. Nodes' numbers of children
+        // are kept in lastEdgeIndex for now.
+        parallelFor(numChunks, [&](const size_t chunk) {
+            ChunkState &state = chunks[chunk];
+            vector<std::pair<int, int>> stack;
+            state.outerChildren.push_back(0);
+            int nextNode = state.firstNode;
+            forEachParenthesis(words, chunk, numBits, [&](const bool open) {
+                if (open) {
+                    if (stack.empty()) {
+                        ++state.outerChildren.back();
+                    } else {
+                        ++stack.back().second;
+                    }
+                    stack.emplace_back(nextNode++, 0);
+                } else if (stack.empty()) {
+                    // closes the innermost node that is open at the chunk's start
+                    state.outerChildren.push_back(0);
+                } else {
+                    tree.nodes[stack.back().first].lastEdgeIndex = stack.back().second;
+                    stack.pop_back();
+                }
+            });
+            state.unmatched.swap(stack);
+        });
+
+        // Determine the nodes that are open at each chunk's start, starting with the root
+        vector<std::pair<int, int>> stack(1, std::make_pair(0, 0));
+        for (ChunkState &chunk : chunks) {
+            const size_t numOuter = chunk.outerChildren.size();
+            assert(stack.size() >= numOuter);
+            for (size_t level = 0; level < numOuter; ++level) {
+                std::pair<int, int> &node = stack[stack.size() - 1 - level];
+                chunk.outerNodes.push_back(node);
+                node.second += chunk.outerChildren[level];
+            }
+            // all but the outermost of them are closed in the chunk
+            for (size_t level = 0; level + 1 < numOuter; ++level) {
+                tree.nodes[stack.back().first].lastEdgeIndex = stack.back().second;
+                stack.pop_back();
+            }
+            stack.insert(stack.end(), chunk.unmatched.begin(), chunk.unmatched.end());
+            vector<std::pair<int, int>>().swap(chunk.unmatched);
+        }
+        assert(stack.size() == 1 && stack[0].first == 0);
+        tree.nodes[0].lastEdgeIndex = stack[0].second;
+        tree.nodes[0].parent = -1;
+
+        // Prefix sum over the numbers of children
+        const size_t nodesPerChunk = chunkWords * 32;
+        const size_t numNodeChunks = (numNodes + nodesPerChunk - 1) / nodesPerChunk;
+        vector<int> edgeOffsets(numNodeChunks, 0);
+        parallelFor(numNodeChunks, [&](const size_t chunk) {
+            const size_t end = std::min<size_t>(numNodes, (chunk + 1) * nodesPerChunk);
+            for (size_t nodeId = chunk * nodesPerChunk; nodeId < end; ++nodeId) {
+                edgeOffsets[chunk] += tree.nodes[nodeId].lastEdgeIndex;
+            }
+        });
+        int firstEdge(1);
+        for (int &offset : edgeOffsets) {
+            std::swap(firstEdge, offset);
+            firstEdge += offset;
+        }
+        assert(firstEdge == (int)numNodes);
+        parallelFor(numNodeChunks, [&](const size_t chunk) {
+            int edge = edgeOffsets[chunk];
+            const size_t end = std::min<size_t>(numNodes, (chunk + 1) * nodesPerChunk);
+            for (size_t nodeId = chunk * nodesPerChunk; nodeId < end; ++nodeId) {
+                const int numChildren = tree.nodes[nodeId].lastEdgeIndex;
+                tree.nodes[nodeId].firstEdgeIndex = edge;
+                edge += numChildren;
+                tree.nodes[nodeId].lastEdgeIndex = edge - 1;
+            }
+        });
+
+        // Second pass: write the edges
+        parallelFor(numChunks, [&](const size_t chunk) {
+            ChunkState &state = chunks[chunk];
+            vector<std::pair<int, int>> stack;
+            size_t level(0);
+            int nextNode = state.firstNode;
+            forEachParenthesis(words, chunk, numBits, [&](const bool open) {
+                if (open) {
+                    std::pair<int, int> &parent = stack.empty() ? state.outerNodes[level] : stack.back();
+                    auto &edge = tree.edges[tree.nodes[parent.first].firstEdgeIndex + parent.second++];
+                    edge.valid = true;
+                    edge.headNode = nextNode;
+                    tree.nodes[nextNode].parent = parent.first;
+                    stack.emplace_back(nextNode++, 0);
+                } else if (stack.empty()) {
+                    ++level;
+                } else {
+                    stack.pop_back();
+                }
+            });
+            vector<std::pair<int, int>>().swap(state.outerNodes);
+        });
+
+        tree._numNodes = tree._firstFreeNode = numNodes;
+        tree._numEdges = numNodes - 1;
+        tree._firstFreeEdge = numNodes;
+    }
+
+protected:
+    /// Per-chunk state of buildTree()
+    struct ChunkState {
+        /// ID of the node of the chunk's first opening parenthesis
+        uint64_t firstNode;
+        /// Number of children that the chunk adds to the nodes open at its start,
+        /// innermost first. Only the outermost of them stays open.
+        vector<int> outerChildren;
+        /// The nodes open at the chunk's start (same order), with their number of children before the chunk
+        vector<std::pair<int, int>> outerNodes;
+        /// The nodes opened but not closed in the chunk, with their number of children in it
+        vector<std::pair<int, int>> unmatched;
+
+        ChunkState() : firstNode(0), outerChildren(), outerNodes(), unmatched() {}
+    };
+
+    /// Call `callback(open)` for every parenthesis of a chunk
+    template <typename Callback>
+    static void forEachParenthesis(const vector<uint64_t> &words, const size_t chunk, const uint64_t numBits,
+                                   const Callback &callback) {
+        const uint64_t end = std::min<uint64_t>(numBits, (chunk + 1) * chunkWords * 64);
+        for (uint64_t pos = chunk * chunkWords * 64; pos < end; pos += 64) {
+            uint64_t word = words[pos / 64];
+            const unsigned int length = std::min<uint64_t>(64, end - pos);
+            for (unsigned int bit = 0; bit < length; ++bit, word >>= 1) {
+                callback(word & 1);
+            }
+        }
+    }
+
+    /// Call `f(chunk)` for every chunk in `[0, numChunks)`, distributing the chunks over the threads
+    template <typename F>
+    void parallelFor(const size_t numChunks, const F &f) const {
+        pool.run(numChunks, [&](const size_t chunk, const int) { f(chunk); });
+    }
+
+    using Base::generator;
+    WorkStealingPool &pool;
+    /// Number of words per chunk (1M bits)
+    static const size_t chunkWords = 1 << 14;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "TopDagTreeUnpacker.h"
+#include "WorkStealingPool.h"
+
+/// Unpack a Top DAG directly into an OrderedTree using multiple threads
+/**
+ * Every cluster's range of node IDs and edge slots in the output is known in
+ * advance (see TopDagTreeUnpacker). The root cluster is therefore split
+ * recursively until all parts are small enough. The parts are then unpacked
+ * by the worker threads, each writing only to its own slices of the
+ * preallocated tree and labels.
+ *
+ * Before the workers start, all of the DAG's labels are set once for the last
+ * node ID. For Labels, this sizes the ID array and inserts every distinct
+ * value, so the workers' set() calls only look up values and write to their
+ * own IDs.
+ */
+template <typename TreeType, typename DataType, typename DAGType = TopDag<DataType>>
+class ParallelTreeUnpacker : public TopDagTreeUnpacker<TreeType, DataType, DAGType> {
+    typedef TopDagTreeUnpacker<TreeType, DataType, DAGType> Base;
+    typedef typename Base::Task Task;
+
+public:
+    /// \param pool the threads to unpack with, which can be reused for other work
+    /// \param tasksPerThread how many tasks to create per thread, for load balancing
+    ParallelTreeUnpacker(const DAGType &dag, TreeType &tree, LabelsT<DataType> &labels, WorkStealingPool &pool,
+                         const int tasksPerThread = 16)
+        : Base(dag, tree, labels), pool(pool), tasksPerThread(tasksPerThread), tasks() {}
+
+    void unpack() {
+        const int rootId = dag.nodes.size() - 1;
+        const long long numNodes = summaries[rootId].numNodes;
+        this->allocate(numNodes);
+        for (size_t nodeId = 1; nodeId < dag.nodes.size(); ++nodeId) {
+            const DagNode<DataType> node = dag.nodes[nodeId];
+            if (node.mergeType == NO_MERGE) labels.set(numNodes - 1, *node.label);
+        }
+
+        // split the root cluster into tasks of at most `maxTaskSize` nodes
+        const long long maxTaskSize = std::max(1ll, numNodes / (pool.getNumThreads() * tasksPerThread));
+        tasks.clear();
+        splitTasks(Task(rootId, -1, 0, 0, 0, 1), maxTaskSize);
+
+        pool.run(tasks.size(), [&](const size_t taskId, const int) {
+            this->unpackCluster(tasks[taskId]);
+        });
+    }
+
+    /// Number of tasks that the last unpack() created
+    size_t getNumTasks() const {
+        return tasks.size();
+    }
+
+protected:
+    using Base::dag;
+    using Base::labels;
+    using Base::summaries;
+
+    /// Split large clusters until their parts have at most `maxTaskSize` nodes
+    void splitTasks(const Task &task, const long long maxTaskSize) {
+        const DagNode<DataType> node = dag.nodes[task.nodeId];
+        if (node.mergeType == NO_MERGE || summaries[task.nodeId].numNodes <= maxTaskSize) {
+            tasks.push_back(task);
+            return;
+        }
+        Task left(task), right(task);
+        this->split(node, task, left, right);
+        splitTasks(left, maxTaskSize);
+        splitTasks(right, maxTaskSize);
+    }
+
+    WorkStealingPool &pool;
+    const int tasksPerThread;
+    std::vector<Task> tasks;
+};
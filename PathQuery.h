@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include "DagSummary.h"
+#include "Navigation.h"
+#include "TopDag.h"
+
+/// Answer many root-to-node path queries on a Top DAG in one sweep
+/**
+ * A path is a sequence of child indices (counting from 0), starting at the
+ * root. The queries are sorted lexicographically so that queries sharing a
+ * prefix are adjacent. A single Navigator then moves from one query's target
+ * to the next by going up to their longest common prefix and down from
+ * there. The DAG stacks of the shared prefix are never decoded again.
+ *
+ * The paths are stored back to back in one array and sorted one level at a
+ * time: each group of queries that agree on the levels so far is distributed
+ * into buckets by its child index on the next level, so that no two whole
+ * paths are compared unless only a few queries share a prefix.
+ *
+ * With summaries, the navigator goes down with Navigator::childAt() and moves
+ * on to a later sibling with Navigator::nextSibling(k), which skips the
+ * clusters in between. Without them, it steps through the siblings one by
+ * one, continuing from the previous query's sibling. That only pays off if
+ * the queries cover most children of the nodes they pass; for few queries
+ * spread over a node with many children, use summaries.
+ */
+template <typename DataType, typename DAGType = TopDag<DataType>>
+class BatchedPathQuery {
+public:
+    typedef std::vector<long long> Path;
+    typedef Navigator<DataType, DAGType> NavigatorType;
+
+    /// \param dag the Top DAG to query
+    /// \param summaries optional cluster summaries of `dag` to skip over siblings
+    BatchedPathQuery(const DAGType &dag, const DagSummaries<DataType, DAGType> *summaries = NULL)
+        : nav(dag, summaries), useSummaries(summaries != NULL), steps(), offsets(1, 0), bucketNext(),
+          bucketEnd(), position(), numMoves(0) {}
+
+    /// Add a query
+    /// \returns the query's ID, which is passed to the callback of run()
+    size_t addQuery(const Path &path) {
+        steps.insert(steps.end(), path.begin(), path.end());
+        offsets.push_back(steps.size());
+        return offsets.size() - 2;
+    }
+
+    size_t numQueries() const {
+        return offsets.size() - 1;
+    }
+
+    /// Evaluate all queries
+    /// \param callback called as `callback(queryId, found, nav)` for every query,
+    /// in lexicographic order of the paths. If `found` is true, `nav` is
+    /// positioned on the query's target node.
+    template <typename Callback>
+    void run(const Callback &callback) {
+        const NavigatorType &current = nav;
+        for (const SortEntry &entry : sortQueries()) {
+            const size_t queryId = entry.queryId;
+            const bool found = moveTo(&steps[offsets[queryId]], offsets[queryId + 1] - offsets[queryId]);
+            callback(queryId, found, current);
+        }
+    }
+
+    /// Evaluate all queries and return the label of each query's target node,
+    /// or NULL if the path doesn't exist in the tree
+    std::vector<const DataType *> getLabels() {
+        std::vector<const DataType *> labels(numQueries(), NULL);
+        run([&](const size_t queryId, const bool found, const NavigatorType &nav) {
+            if (found) labels[queryId] = nav.getLabel();
+        });
+        return labels;
+    }
+
+    /// Number of navigator moves performed so far
+    unsigned long long getNumMoves() const {
+        return numMoves;
+    }
+
+protected:
+    /// A query and its child index on the level being sorted
+    struct SortEntry {
+        long long index;
+        size_t queryId;
+
+        bool operator<(const SortEntry &other) const {
+            return index < other.index;
+        }
+    };
+
+    /// Sort the queries lexicographically by their paths
+    std::vector<SortEntry> sortQueries() {
+        std::vector<SortEntry> entries(numQueries());
+        for (size_t queryId = 0; queryId < entries.size(); ++queryId) {
+            entries[queryId].queryId = queryId;
+        }
+        // ranges [begin, end) of entries that agree on all levels before `level`
+        struct Range {
+            size_t begin, end, level;
+        };
+        std::vector<Range> ranges;
+        if (entries.size() > 1) ranges.push_back(Range{0, entries.size(), 0});
+        while (!ranges.empty()) {
+            const Range range = ranges.back();
+            ranges.pop_back();
+            if (range.end - range.begin <= maxSuffixSortSize) {
+                // few queries: compare the rest of their paths at once
+                const auto suffixLess = [&](const SortEntry &a, const SortEntry &b) {
+                    const auto first = steps.begin();
+                    return std::lexicographical_compare(first + offsets[a.queryId] + range.level,
+                                                        first + offsets[a.queryId + 1],
+                                                        first + offsets[b.queryId] + range.level,
+                                                        first + offsets[b.queryId + 1]);
+                };
+                std::sort(entries.begin() + range.begin, entries.begin() + range.end, suffixLess);
+                continue;
+            }
+
+            // paths that end before `level` go first, as they are prefixes of the others
+            size_t middle = range.begin;
+            long long minIndex = std::numeric_limits<long long>::max();
+            long long maxIndex = std::numeric_limits<long long>::min();
+            for (size_t i = range.begin; i < range.end; ++i) {
+                const size_t queryId = entries[i].queryId;
+                if (offsets[queryId] + range.level < offsets[queryId + 1]) {
+                    entries[i].index = steps[offsets[queryId] + range.level];
+                    minIndex = std::min(minIndex, entries[i].index);
+                    maxIndex = std::max(maxIndex, entries[i].index);
+                } else {
+                    std::swap(entries[i], entries[middle++]);
+                }
+            }
+            if (middle == range.end) continue;
+            distribute(entries, middle, range.end, minIndex, maxIndex);
+
+            for (size_t begin = middle, end; begin < range.end; begin = end) {
+                end = begin + 1;
+                while (end < range.end && entries[end].index == entries[begin].index) ++end;
+                if (end - begin > 1) {
+                    ranges.push_back(Range{begin, end, range.level + 1});
+                }
+            }
+        }
+        return entries;
+    }
+
+    /// Sort entries[begin, end) by their child indices, which lie between minIndex and maxIndex
+    /**
+     * The entries are distributed in place into about twice as many buckets as
+     * there are entries, by the high bits of their child index, so that most
+     * buckets hold at most one distinct index.
+     */
+    void distribute(std::vector<SortEntry> &entries, const size_t begin, const size_t end, const long long minIndex,
+                    const long long maxIndex) {
+        const unsigned long long span = (unsigned long long)maxIndex - (unsigned long long)minIndex;
+        int shift = 0;
+        while ((span >> shift) >= 2 * (end - begin)) ++shift;
+        const auto bucketOf = [&](const SortEntry &entry) -> size_t {
+            return ((unsigned long long)entry.index - (unsigned long long)minIndex) >> shift;
+        };
+
+        bucketEnd.assign((span >> shift) + 1, 0);
+        for (size_t i = begin; i < end; ++i) {
+            ++bucketEnd[bucketOf(entries[i])];
+        }
+        bucketEnd[0] += begin;
+        std::partial_sum(bucketEnd.begin(), bucketEnd.end(), bucketEnd.begin());
+        bucketNext.resize(bucketEnd.size());
+        bucketNext[0] = begin;
+        std::copy(bucketEnd.begin(), bucketEnd.end() - 1, bucketNext.begin() + 1);
+        for (size_t bucket = 0; bucket < bucketEnd.size(); ++bucket) {
+            while (bucketNext[bucket] < bucketEnd[bucket]) {
+                SortEntry &entry = entries[bucketNext[bucket]];
+                const size_t target = bucketOf(entry);
+                if (target == bucket) {
+                    ++bucketNext[bucket];
+                } else {
+                    std::swap(entry, entries[bucketNext[target]++]);
+                }
+            }
+        }
+
+        // a bucket spans several child indices unless shift is 0
+        if (shift == 0) return;
+        for (size_t bucket = 0, bucketBegin = begin; bucket < bucketEnd.size(); bucketBegin = bucketEnd[bucket++]) {
+            if (bucketEnd[bucket] - bucketBegin > 1) {
+                std::sort(entries.begin() + bucketBegin, entries.begin() + bucketEnd[bucket]);
+            }
+        }
+    }
+
+    /// Move the navigator to the node at the given path
+    /// \returns whether the node exists
+    bool moveTo(const long long *path, const size_t length) {
+        size_t prefix = 0;
+        while (prefix < position.size() && prefix < length && position[prefix] == path[prefix]) {
+            ++prefix;
+        }
+        if (verbose) std::cout << "PQ: common prefix of length " << prefix << std::endl;
+
+        // go up to the longest common prefix, but stay on the first differing
+        // level if we can continue from there with nextSibling()
+        const bool stepSiblings = prefix < position.size() && prefix < length && position[prefix] < path[prefix];
+        while (position.size() > prefix + stepSiblings) {
+            up();
+        }
+
+        for (size_t level = prefix; level < length; ++level) {
+            if (path[level] < 0) return false;
+            if (useSummaries) {
+                if (position.size() == level) {
+                    if (!nav.childAt(path[level])) return false;
+                    position.push_back(path[level]);
+                } else {
+                    if (!nav.nextSibling(path[level] - position.back())) return false;
+                    position.back() = path[level];
+                }
+                ++numMoves;
+                continue;
+            }
+            if (position.size() == level) {
+                if (!nav.firstChild()) return false;
+                ++numMoves;
+                position.push_back(0);
+            }
+            while (position.back() < path[level]) {
+                if (!nav.nextSibling()) return false;
+                ++numMoves;
+                ++position.back();
+            }
+        }
+        return true;
+    }
+
+    void up() {
+        nav.parent();
+        ++numMoves;
+        position.pop_back();
+    }
+
+    NavigatorType nav;
+    const bool useSummaries;
+    /// The queries' paths, back to back
+    std::vector<long long> steps;
+    /// Query `i`'s path is steps[offsets[i]] to steps[offsets[i + 1]] (exclusive)
+    std::vector<size_t> offsets;
+    /// Scratch space for distribute(): the next free slot and the end of each bucket
+    std::vector<size_t> bucketNext, bucketEnd;
+    /// Child indices on the path from the root to the navigator's current node
+    Path position;
+    unsigned long long numMoves;
+    /// Queries that agree on a prefix are sorted by the rest of their paths if there are at most this many,
+    /// and one level at a time otherwise
+    static const size_t maxSuffixSortSize = 32;
+    static const bool verbose = false;
+};
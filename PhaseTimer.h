@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// A tree of nested phases and the time spent in each of them
+/**
+ * Nodes are identified by their parent, name and (optional) index, so that
+ * entering the same phase again, e.g., in the next tree or call, adds to the
+ * same node. Node 0 is the root and has no name.
+ */
+class PhaseTree {
+public:
+    typedef std::chrono::steady_clock::duration Duration;
+
+    struct Node {
+        /// the phase's name, which must outlive the tree (e.g., a string literal)
+        const char *name;
+        /// appended to the name unless negative, e.g., for iterations
+        int index;
+        int parent;
+        std::vector<int> children;
+        Duration total;
+        /// how often the phase was run
+        uint64_t count;
+
+        Node(const char *name, const int index, const int parent)
+            : name(name), index(index), parent(parent), children(), total(Duration::zero()), count(0) {}
+    };
+
+    PhaseTree() : nodes(), current(0) {
+        nodes.emplace_back("", -1, -1);
+    }
+
+    /// Enter a child phase of the current one
+    /// \returns the child's node ID
+    int enter(const char *name, const int index = -1) {
+        current = findOrAddChild(current, name, index);
+        return current;
+    }
+
+    /// Leave a phase, adding its duration. This must be the current phase.
+    void leave(const int nodeId, const Duration duration) {
+        Node &node = nodes[nodeId];
+        node.total += duration;
+        ++node.count;
+        current = node.parent;
+    }
+
+    /// Add another tree's times to this one
+    void merge(const PhaseTree &other) {
+        merge(other, 0, 0);
+    }
+
+    /// Write the tree as folded stacks ("outer;inner <self time in µs>" per line), as used by flamegraph.pl
+    void writeFolded(std::ostream &os) const {
+        for (const int child : nodes[0].children) {
+            writeFolded(os, child, "");
+        }
+    }
+
+    /// Write an indented summary of the total times and counts
+    void writeSummary(std::ostream &os) const {
+        for (const int child : nodes[0].children) {
+            writeSummary(os, child, 0);
+        }
+    }
+
+    std::vector<Node> nodes;
+    int current;
+
+protected:
+    int findOrAddChild(const int parent, const char *name, const int index) {
+        for (const int child : nodes[parent].children) {
+            const Node &node = nodes[child];
+            if (node.index == index && (node.name == name || strcmp(node.name, name) == 0)) return child;
+        }
+        nodes.emplace_back(name, index, parent);
+        nodes[parent].children.push_back(nodes.size() - 1);
+        return nodes.size() - 1;
+    }
+
+    void merge(const PhaseTree &other, const int otherId, const int nodeId) {
+        for (const int otherChild : other.nodes[otherId].children) {
+            const Node &source = other.nodes[otherChild];
+            const int child = findOrAddChild(nodeId, source.name, source.index);
+            nodes[child].total += source.total;
+            nodes[child].count += source.count;
+            merge(other, otherChild, child);
+        }
+    }
+
+    std::string label(const int nodeId) const {
+        const Node &node = nodes[nodeId];
+        return node.index < 0 ? std::string(node.name) : std::string(node.name) + " " + std::to_string(node.index);
+    }
+
+    static long long micros(const Duration duration) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+
+    void writeFolded(std::ostream &os, const int nodeId, const std::string &prefix) const {
+        const Node &node = nodes[nodeId];
+        const std::string path = prefix + label(nodeId);
+        Duration self = node.total;
+        for (const int child : node.children) {
+            self -= nodes[child].total;
+            writeFolded(os, child, path + ";");
+        }
+        os << path << " " << std::max(0LL, micros(self)) << '\n';
+    }
+
+    void writeSummary(std::ostream &os, const int nodeId, const int depth) const {
+        const Node &node = nodes[nodeId];
+        os << std::string(2 * depth, ' ') << label(nodeId) << ": " << micros(node.total) / 1000.0 << "ms ("
+           << node.count << "x)" << '\n';
+        for (const int child : node.children) {
+            writeSummary(os, child, depth + 1);
+        }
+    }
+};
+
+/// The phase trees of all threads
+/**
+ * Every thread records into its own tree, so timing a phase takes no lock.
+ * A thread's tree is registered (under a lock) when it first times a phase
+ * and outlives the thread. At exit, the trees are merged and written as folded
+ * stacks to the file named by the PHASE_TIMES environment variable, if set,
+ * e.g., for `flamegraph.pl`. This must not happen while other threads are
+ * still timing phases.
+ */
+class PhaseTimers {
+public:
+    /// The calling thread's tree
+    static PhaseTree &local() {
+        static thread_local PhaseTree *tree = nullptr;
+        if (tree == nullptr) {
+            PhaseTimers &timers = instance();
+            std::lock_guard<std::mutex> lock(timers.mutex);
+            timers.trees.emplace_back(new PhaseTree());
+            tree = timers.trees.back().get();
+        }
+        return *tree;
+    }
+
+    /// All threads' trees, merged
+    static PhaseTree merged() {
+        PhaseTimers &timers = instance();
+        std::lock_guard<std::mutex> lock(timers.mutex);
+        PhaseTree result;
+        for (const std::unique_ptr<PhaseTree> &tree : timers.trees) {
+            result.merge(*tree);
+        }
+        return result;
+    }
+
+    ~PhaseTimers() {
+        const char *filename = std::getenv("PHASE_TIMES");
+        if (filename == nullptr || *filename == '\0') return;
+        std::ofstream out(filename);
+        if (!out.is_open()) {
+            std::cerr << "Could not write phase times to " << filename << std::endl;
+            return;
+        }
+        merged().writeFolded(out);
+    }
+
+protected:
+    PhaseTimers() : mutex(), trees() {}
+
+    static PhaseTimers &instance() {
+        static PhaseTimers timers;
+        return timers;
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<PhaseTree>> trees;
+};
+
+/// Times a phase from its creation until stop() or its destruction, as a child of the enclosing phase
+/**
+ * Usage: `ScopedPhase phase("construct");`. Phases of a thread must be
+ * stopped in the reverse order of their creation, which scopes ensure.
+ */
+class ScopedPhase {
+public:
+    /// \param name the phase's name, which must outlive the program's phase trees (use a string literal)
+    /// \param index optional index to tell phases with the same name apart, e.g., iterations
+    explicit ScopedPhase(const char *name, const int index = -1)
+        : tree(PhaseTimers::local()), nodeId(tree.enter(name, index)), running(true),
+          start(std::chrono::steady_clock::now()), duration(PhaseTree::Duration::zero()) {}
+
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+    ~ScopedPhase() {
+        stop();
+    }
+
+    /// End the phase early
+    /// \returns its duration in milliseconds
+    double stop() {
+        if (running) {
+            duration = std::chrono::steady_clock::now() - start;
+            tree.leave(nodeId, duration);
+            running = false;
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1000.0;
+    }
+
+protected:
+    PhaseTree &tree;
+    const int nodeId;
+    bool running;
+    const std::chrono::steady_clock::time_point start;
+    PhaseTree::Duration duration;
+};
@@ -2,172 +2,231 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <vector>
 
+#include "BPString.h"
+
 using std::cout;
 using std::endl;
 using std::vector;
 
 /// Generates ordered unlabelled trees uniformly at random
+/**
+ * A tree with `n` edges is given by its balanced parenthesis sequence of `n`
+ * pairs, without the root's pair. To sample one uniformly at random, we
+ * draw a uniformly random sequence of `n` opening and `n + 1` closing
+ * parentheses. By the cycle lemma, exactly one of its rotations has only
+ * non-negative proper prefix excesses: the one starting after the first
+ * position of minimum excess. It ends in a closing parenthesis, and
+ * dropping that leaves a balanced sequence. Every balanced sequence is
+ * obtained from exactly `2n + 1` sequences this way, so it is uniform.
+ *
+ * All steps work on packed 64-bit words and take linear time.
+ */
 template <typename RNG>
 class RandomTreeGenerator {
 public:
     /// Create a random tree generator
     /// \param gen the random generator to use
-    RandomTreeGenerator(RNG &gen) : generator(gen), distribution(0.0, 1.0) {}
-
-    // Knuth random sampling algorithm from page 137 of
-    // D.E. Knuth, Semi-numerical Algorithms, The Art of Computer Programming, Vol. 2 (Addision-Wesley, Reading, MA, 2nd ed., 1981).
-    void selectionSampling(vector<bool> &result, const int n, const int N) {
-        int t(0), m(0);
-        result.assign(N, false);
-        while (m < n) {
-            double U = distribution(generator);
-            if (((N - t) * U) < (n - m)) {
-                m++;
-                result[t] = true;
-            }
-            t++;
-        }
-    }
-
-    /// Generate a uniformly random balanced parenthesis bitstring, which defines a tree
-    /// \param result a bool-vector for the output tree
-    /// \param numNodes the number of nodes that the tree shall have
-    void randomBalancedParenthesisBitstring(vector<bool> &result, const int numNodes) {
-        vector<bool> sequence;
-        selectionSampling(sequence, numNodes, 2 * numNodes);
-        result.assign(numNodes * 2, false);
-
-        phi<vector<bool>>(sequence.cbegin(), sequence.cend(), result.begin());
-
-        assert(isWellFormed<vector<bool>>(result.begin(), result.end()));
+    RandomTreeGenerator(RNG &gen) : generator(gen) {}
+
+    /// Generate a uniformly random balanced parenthesis sequence, which defines a tree
+    /// \param words output, bit `i` of the sequence is bit `i % 64` of word `i / 64`,
+    /// and 1 is an opening parenthesis
+    /// \param numPairs the number of parenthesis pairs (i.e., the tree's number of edges)
+    void randomBalancedParentheses(vector<uint64_t> &words, const uint64_t numPairs) {
+        const uint64_t length = 2 * numPairs + 1;
+        vector<uint64_t> sequence;
+        randomSubset(sequence, numPairs, length);
+
+        const uint64_t start = firstMinimumExcess(sequence, length);
+        // rotate the sequence to begin at `start`, leaving out the closing parenthesis before it
+        words.assign((2 * numPairs + 63) / 64 + 1, 0);
+        copyBits(sequence, start, length - start, words, 0);
+        copyBits(sequence, 0, start - 1, words, length - start);
+        words.resize((2 * numPairs + 63) / 64);
+        assert(isWellFormed(words, 2 * numPairs));
     }
 
     /// Generate an unlabelled ordered tree uniformly at random
-    /// \param tree a bool-vector for the output tree
+    /// \param tree an empty tree, its nodes are numbered in preorder
     /// \param numEdges the number of edges that the tree shall have
     /// \param verbose whether to print the bitstring to stdout
     template <typename TreeType>
     void generateTree(TreeType &tree, const int numEdges, const bool verbose = false) {
-        vector<bool> bitstring;
+        vector<uint64_t> words;
         // numEdges, because the root is not included in the bitstring
-        randomBalancedParenthesisBitstring(bitstring, numEdges);
+        randomBalancedParentheses(words, numEdges);
 
         if (verbose) {
             cout << "Bitstring: (";
-            for (bool b : bitstring) {
-                cout << (b ? "(" : ")");
+            for (uint64_t i = 0; i < 2 * (uint64_t)numEdges; ++i) {
+                cout << (getBit(words, i) ? "(" : ")");
             }
             cout << ")" << endl;
         }
 
-        const int root = tree.addNode();
-        createTree<vector<bool>>(bitstring.cbegin(), bitstring.cend(), root, tree);
-        tree.compact(false);
+        // wrap the bitstring in the root's parentheses
+        const size_t length = 2 * (size_t)numEdges + 2;
+        __attribute__((unused)) // to make compiler happy when assertions are disabled
+        const bool valid = BPString::buildTree(tree, length, [&](const size_t i) {
+            return i == 0 || (i < length - 1 && getBit(words, i - 1));
+        });
+        assert(valid);
+    }
+
+    static bool getBit(const vector<uint64_t> &words, const uint64_t pos) {
+        return (words[pos / 64] >> (pos % 64)) & 1;
     }
 
 protected:
-    /// Recursively create a tree from a parenthesis bitstring
-    /// \param begin iterator to the beginning of the bitstring
-    /// \param end iterator past the end of the bistring
-    /// \param parentId parent node of the node to add
-    /// \param tree the output tree -- node parentId needs to exist before calling this
-    template <typename T, typename TreeType>
-    static typename T::const_iterator createTree(typename T::const_iterator begin, typename T::const_iterator end,
-                                                 const int parentId, TreeType &tree) {
-        if (*begin == false) {
-            return ++begin;
+    /// Excess of a range of bits
+    struct RangeExcess {
+        /// the excess after all bits
+        int64_t excess;
+        /// the minimum excess after at least one bit
+        int64_t minimum;
+        /// the smallest number of bits after which the minimum is reached
+        uint64_t minimumPos;
+    };
+
+    /// Excess information of a byte, read from the least significant bit
+    struct ByteExcess {
+        /// the excess after all 8 bits
+        int excess;
+        /// the minimum excess after 1 to 8 bits
+        int minimum;
+        /// the smallest number of bits after which the minimum is reached
+        int minimumPos;
+    };
+
+    /// Draw a uniformly random subset of size `k` of `{0, ..., n - 1}` as a bitvector
+    /**
+     * Draw uniformly random bits, then flip randomly chosen set (or unset) bits
+     * until exactly `k` are set. Conditioned on the number of set bits, the
+     * random bits are a uniform subset of that size, and removing (or adding)
+     * uniformly random elements keeps it uniform. The expected number of flips
+     * is O(sqrt(n)).
+     */
+    void randomSubset(vector<uint64_t> &words, const uint64_t k, const uint64_t n) {
+        words.resize((n + 63) / 64);
+        uint64_t count(0);
+        for (uint64_t &word : words) {
+            word = ((uint64_t)generator() << 32) ^ (uint64_t)generator();
         }
-        while (begin != end) {
-            if (*begin == true) {
-                int nodeId = tree.addNode();
-                tree.addEdge(parentId, nodeId);
-                ++begin;
-                begin = createTree<T, TreeType>(begin, end, nodeId, tree);
-            } else {
-                ++begin;
-                break;
-            }
+        if (n % 64 != 0) {
+            words.back() &= ((uint64_t)1 << (n % 64)) - 1;
         }
-        return begin;
-    }
-
-    /// transform a balanced word into a well-formed balanced word. Algorithm from
-    /// Atkinson, Michael D., and J-R. Sack. "Generating binary trees at random." Information Processing Letters 41.1 (1992): 21-23.
-    template <typename T>
-    static typename T::iterator phi(typename T::const_iterator begin, typename T::const_iterator end,
-                                    typename T::iterator outIt) {
-        if (end <= begin) {
-            return outIt;
+        for (const uint64_t word : words) {
+            count += __builtin_popcountll(word);
         }
+        correctCount(words, count, k, n);
+    }
 
-        typename T::const_iterator index = reducibleIndex<T>(begin, end);
-
-        if (isWellFormed<T>(begin, index)) {
-            outIt = std::copy(begin, index, outIt);
-            outIt = phi<T>(index, end, outIt);
-        } else {
-            *outIt = 1;
-            ++outIt;
-            outIt = phi<T>(index, end, outIt);
-            *outIt = 0;
-            ++outIt;
-
-            ++begin;
-            --index;
-            while (begin != index) {
-                *outIt = !*begin;
-                ++outIt; ++begin;
+    /// Flip random bits of the first `n` until `k` of them are set, see randomSubset()
+    /// \param count the number of bits that are currently set
+    void correctCount(vector<uint64_t> &words, uint64_t count, const uint64_t k, const uint64_t n) {
+        std::uniform_int_distribution<uint64_t> position(0, n - 1);
+        while (count != k) {
+            const bool remove = count > k;
+            const uint64_t pos = position(generator);
+            if (getBit(words, pos) == remove) {
+                words[pos / 64] ^= (uint64_t)1 << (pos % 64);
+                if (remove) --count; else ++count;
             }
         }
+    }
 
-        return outIt;
+    /// Find the smallest `j >= 1` such that the excess of the first `j` bits
+    /// is minimal (1 = +1, 0 = -1)
+    static uint64_t firstMinimumExcess(const vector<uint64_t> &words, const uint64_t length) {
+        __attribute__((unused)) // to make compiler happy when assertions are disabled
+        const RangeExcess range = rangeExcess(words, 0, length);
+        assert(range.excess == -1 && range.minimumPos >= 1);
+        return range.minimumPos;
     }
 
-    /// check wether [begin, end) balanced, i.e. has same number of opening and closing parentheses
-    /// \param begin defines the beginning of the sequence to check
-    /// \param end defines the item past the end of the sequence to check
-    /// \return true iff [begin, end) is balanced
-    static bool isBalanced(vector<bool>::const_iterator begin, vector<bool>::const_iterator end) {
-        // an odd-length sequence can't be balanced
-        if ((end - begin) % 2 == 1) {
-            return false;
+    /// Compute the excess of bits `from` to `to - 1` (`from` must be a multiple of 8)
+    static RangeExcess rangeExcess(const vector<uint64_t> &words, const uint64_t from, const uint64_t to) {
+        static const vector<ByteExcess> table = byteExcessTable();
+        assert(from % 8 == 0);
+        RangeExcess result{0, std::numeric_limits<int64_t>::max(), 0};
+        uint64_t pos(from);
+        // whole bytes
+        for (; pos + 8 <= to; pos += 8) {
+            const ByteExcess &byte = table[(words[pos / 64] >> (pos % 64)) & 0xff];
+            if (result.excess + byte.minimum < result.minimum) {
+                result.minimum = result.excess + byte.minimum;
+                result.minimumPos = pos - from + byte.minimumPos;
+            }
+            result.excess += byte.excess;
         }
-        int count(0);
-        for (auto it = begin; it != end; ++it) {
-            count += *it;
+        // the rest
+        for (; pos < to; ++pos) {
+            result.excess += getBit(words, pos) ? 1 : -1;
+            if (result.excess < result.minimum) {
+                result.minimum = result.excess;
+                result.minimumPos = pos - from + 1;
+            }
         }
-        return (count * 2) == (end - begin);
+        return result;
     }
 
-    /// is [begin, end) well-formed?
-    template <typename T>
-    static bool isWellFormed(typename T::const_iterator begin, typename T::const_iterator end) {
-        int balance(0);
-        for (typename T::const_iterator it = begin; it != end; ++it) {
-            balance += *it ? 1 : -1;
-            if (balance < 0) return false;
+    static vector<ByteExcess> byteExcessTable() {
+        vector<ByteExcess> table(256);
+        for (int byte = 0; byte < 256; ++byte) {
+            ByteExcess &entry = table[byte];
+            entry.excess = 0;
+            entry.minimum = 9;
+            for (int bit = 0; bit < 8; ++bit) {
+                entry.excess += ((byte >> bit) & 1) ? 1 : -1;
+                if (entry.excess < entry.minimum) {
+                    entry.minimum = entry.excess;
+                    entry.minimumPos = bit + 1;
+                }
+            }
+        }
+        return table;
+    }
+
+    /// Read `length` <= 64 bits starting at bit `pos`
+    static uint64_t readBits(const vector<uint64_t> &words, const uint64_t pos, const unsigned int length) {
+        if (length == 0) return 0;
+        const unsigned int offset = pos % 64;
+        uint64_t bits = words[pos / 64] >> offset;
+        if (offset > 0 && offset + length > 64) {
+            bits |= words[pos / 64 + 1] << (64 - offset);
         }
-        return true;
+        return (length == 64) ? bits : (bits & (((uint64_t)1 << length) - 1));
     }
 
-    /// separate [begin, end) into [begin, result) (irreducible) and [result, end) so that
-    /// [begin, end) is balanced
-    template <typename T>
-    static typename T::const_iterator reducibleIndex(typename T::const_iterator begin, typename T::const_iterator end) {
-        int delta(0);
-        for (typename T::const_iterator it = begin; it != end; ++it) {
-            delta += *it ? 1 : -1;
-            if (delta == 0) {
-                return it + 1;
+    /// Copy `length` bits starting at bit `from` of `source` to bit `to` of
+    /// `target`. The target's bits from `to` on must be zero, and it needs a spare word at the end.
+    static void copyBits(const vector<uint64_t> &source, const uint64_t from, const uint64_t length,
+                         vector<uint64_t> &target, uint64_t to) {
+        for (uint64_t done = 0; done < length; done += 64, to += 64) {
+            const uint64_t bits = readBits(source, from + done, std::min<uint64_t>(64, length - done));
+            const unsigned int offset = to % 64;
+            target[to / 64] |= bits << offset;
+            if (offset > 0) {
+                target[to / 64 + 1] |= bits >> (64 - offset);
             }
         }
-        return end;
+    }
+
+    /// Check whether the first `length` bits are a balanced parenthesis sequence
+    static bool isWellFormed(const vector<uint64_t> &words, const uint64_t length) {
+        int64_t balance(0);
+        for (uint64_t pos = 0; pos < length; ++pos) {
+            balance += getBit(words, pos) ? 1 : -1;
+            if (balance < 0) return false;
+        }
+        return balance == 0;
     }
 
     RNG &generator;
-    std::uniform_real_distribution<double> distribution;
-};
\ No newline at end of file
+};
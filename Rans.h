@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include "Common.h"
+
+/// Interleaved range asymmetric numeral systems (rANS) coder with a static model
+/**
+ * Collects a sequence of symbols, quantises their frequencies to a power of two
+ * and codes the sequence with `numLanes` interleaved rANS states. Unlike Huffman
+ * coding, this spends a fractional number of bits per symbol, which matters for
+ * small, skewed alphabets like merge types and structure bits.
+ *
+ * States are 64 bits wide and renormalised 32 bits at a time (as in Fabian
+ * Giesen's rans64), so the probability resolution can go up to 31 bits, which
+ * leaves room for large alphabets such as DAG pointers.
+ *
+ * Symbols must be of an integral type and are remapped to dense IDs like in
+ * HuffmanBuilder.
+ */
+template <typename SymbolType, int numLanes = 4>
+class RansCoder {
+    static_assert(std::is_integral<SymbolType>::value, "RansCoder requires integral symbols");
+    static_assert(numLanes > 0, "RansCoder needs at least one lane");
+    typedef typename std::make_unsigned<SymbolType>::type IndexType;
+
+    /// Lower bound of the normalisation interval
+    static const uint64_t ransL = 1ull << 31;
+    /// Minimum probability resolution in bits
+    static const unsigned int minProbBits = 12;
+    /// Maximum probability resolution (limited by the normalisation interval)
+    static const unsigned int maxProbBits = 31;
+    /// Maximum probability resolution for which the decoder uses a slot lookup table
+    static const unsigned int maxTableBits = 16;
+
+public:
+    RansCoder() : probBits(0), symbolIds(), symbols(), frequencies(), sequence(), cumFreqs(), output() {}
+
+    /// add an occurence to the sequence to be coded
+    void addItem(const SymbolType &symbol) {
+        const size_t index = (IndexType)symbol;
+        if (index >= symbolIds.size()) {
+            symbolIds.resize(index + 1, -1);
+        }
+        int &id = symbolIds[index];
+        if (id < 0) {
+            id = (int)symbols.size();
+            symbols.push_back(symbol);
+            frequencies.push_back(0);
+        }
+        frequencies[id]++;
+        sequence.push_back(id);
+    }
+
+    /// add a sequence of occurences
+    template <class InputIterator>
+    void addItems(InputIterator begin, InputIterator end) {
+        for (auto it = begin; it != end; ++it) {
+            addItem(*it);
+        }
+    }
+
+    /// Quantise the frequencies and encode the sequence
+    void construct() {
+        normaliseFrequencies();
+        encode();
+    }
+
+    /// Get the number of different symbols encountered
+    int getNumSymbols() const {
+        return symbols.size();
+    }
+
+    /// Get the total number of occurences encountered
+    int getNumItems() const {
+        return sequence.size();
+    }
+
+    /// The probability resolution (in bits) chosen for the quantised frequencies
+    unsigned int getProbBits() const {
+        return probBits;
+    }
+
+    /// Get the number of bits of the encoded sequence, including the final lane states.
+    /// Need to have called construct() before.
+    long long getBitsNeeded() const {
+        return static_cast<long long>(output.size()) * 32;
+    }
+
+    /// Get the number of bits to store the quantised frequency table (gamma-coded frequencies,
+    /// plus the probability resolution). Symbol labels are not included.
+    long long getBitsForTable() const {
+        long long bits = 2 * log2ceil(maxProbBits + 1) + 1;
+        for (size_t id = 0; id < symbols.size(); ++id) {
+            bits += 2 * log2_floor_template(quantised(id)) + 1;
+        }
+        return bits;
+    }
+
+    /// Get the number of bits that are required to store the labels to the table entries,
+    /// as fixed-length codes (same as HuffmanBuilder::getBitsForTableLabels())
+    long long getBitsForTableLabels() const {
+        return static_cast<long long>(getNumSymbols()) * (1 + log2ceil(getNumSymbols()));
+    }
+
+    /// Decode the encoded sequence again. Need to have called construct() before.
+    /// \param result will hold the decoded symbols
+    void decode(std::vector<SymbolType> &result) const {
+        const size_t n = sequence.size();
+        result.resize(n);
+        if (n == 0) return;
+
+        const uint32_t mask = (1u << probBits) - 1;
+        const bool useTable = probBits <= maxTableBits;
+        std::vector<uint32_t> slotToId;
+        if (useTable) {
+            slotToId.resize(1u << probBits);
+            for (size_t id = 0; id < symbols.size(); ++id) {
+                std::fill(slotToId.begin() + cumFreqs[id], slotToId.begin() + cumFreqs[id + 1], id);
+            }
+        }
+
+        const uint32_t *in = output.data();
+        uint64_t state[numLanes];
+        for (int lane = 0; lane < numLanes; ++lane) {
+            state[lane] = ((uint64_t)in[0] << 32) | in[1];
+            in += 2;
+        }
+
+        // Each block decodes one symbol per lane. The first loop has no dependencies between
+        // the lanes and no data-dependent reads except for the table, so the compiler can
+        // vectorise it; renormalisation has to consume the stream in lane order and stays scalar.
+        uint32_t ids[numLanes];
+        for (size_t base = 0; base < n; base += numLanes) {
+            const int lanes = (int)std::min<size_t>(numLanes, n - base);
+            for (int lane = 0; lane < lanes; ++lane) {
+                const uint32_t slot = state[lane] & mask;
+                const uint32_t id = useTable ? slotToId[slot] : findSlot(slot);
+                ids[lane] = id;
+                state[lane] = quantised(id) * (state[lane] >> probBits) + slot - cumFreqs[id];
+            }
+            for (int lane = 0; lane < lanes; ++lane) {
+                result[base + lane] = symbols[ids[lane]];
+                if (state[lane] < ransL) {
+                    state[lane] = (state[lane] << 32) | *in++;
+                }
+            }
+        }
+        assert(in == output.data() + output.size());
+    }
+
+    /// Check whether decoding reproduces the input sequence
+    bool verify() const {
+        std::vector<SymbolType> decoded;
+        decode(decoded);
+        for (size_t i = 0; i < sequence.size(); ++i) {
+            if (decoded[i] != symbols[sequence[i]]) return false;
+        }
+        return true;
+    }
+
+    /// Print summary to an ostream
+    friend std::ostream &operator<<(std::ostream &os, const RansCoder &rans) {
+        return os << "rANS (" << numLanes << " lanes, " << rans.getProbBits() << " bit probabilities) with "
+                  << rans.getNumSymbols() << " symbols and " << rans.getNumItems() << " occurrences, need "
+                  << rans.getBitsNeeded() << " bits";
+    }
+
+protected:
+    uint32_t quantised(const size_t id) const {
+        return cumFreqs[id + 1] - cumFreqs[id];
+    }
+
+    /// Find the symbol ID whose slot range contains `slot` (for large alphabets)
+    uint32_t findSlot(const uint32_t slot) const {
+        return std::upper_bound(cumFreqs.begin(), cumFreqs.end(), slot) - cumFreqs.begin() - 1;
+    }
+
+    /// Scale the frequencies so that they sum up to 2^probBits, keeping every symbol's frequency >= 1
+    void normaliseFrequencies() {
+        const size_t numSymbols = symbols.size();
+        probBits = log2ceil(numSymbols) + 2;
+        if (probBits < minProbBits) probBits = minProbBits;
+        if (probBits > maxProbBits) probBits = maxProbBits;
+        assert(numSymbols <= (1ull << probBits));
+        cumFreqs.assign(numSymbols + 1, 0);
+        if (numSymbols == 0) return;
+        const uint64_t total = 1ull << probBits;
+        const uint64_t numItems = sequence.size();
+
+        std::vector<uint32_t> scaled(numSymbols);
+        int64_t sum(0);
+        size_t largest(0);
+        for (size_t id = 0; id < numSymbols; ++id) {
+            scaled[id] = std::max<uint64_t>(1, (frequencies[id] * total) / numItems);
+            sum += scaled[id];
+            if (frequencies[id] > frequencies[largest]) largest = id;
+        }
+
+        // Rounding leaves us a little off, take the difference from or give it to the most frequent symbols
+        int64_t diff = (int64_t)total - sum;
+        if (diff > 0) {
+            scaled[largest] += diff;
+        } else {
+            std::vector<uint32_t> order(numSymbols);
+            for (size_t id = 0; id < numSymbols; ++id) order[id] = id;
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return scaled[a] > scaled[b]; });
+            while (diff < 0) {
+                for (size_t i = 0; i < numSymbols && diff < 0 && scaled[order[i]] > 1; ++i) {
+                    const uint32_t take = std::min<int64_t>(-diff, std::max<uint32_t>(1, scaled[order[i]] / 16));
+                    scaled[order[i]] -= take;
+                    diff += take;
+                }
+            }
+        }
+
+        for (size_t id = 0; id < numSymbols; ++id) {
+            cumFreqs[id + 1] = cumFreqs[id] + scaled[id];
+        }
+        assert(cumFreqs.back() == total);
+    }
+
+    /// Encode the sequence back to front, so that it can be decoded front to back
+    void encode() {
+        output.clear();
+        if (sequence.empty()) return;
+        uint64_t state[numLanes];
+        std::fill(state, state + numLanes, ransL);
+
+        for (size_t i = sequence.size(); i--;) {
+            uint64_t &x = state[i % numLanes];
+            const uint32_t id = sequence[i];
+            const uint64_t freq = quantised(id);
+            // renormalise
+            const uint64_t xMax = ((ransL >> probBits) << 32) * freq;
+            if (x >= xMax) {
+                output.push_back((uint32_t)x);
+                x >>= 32;
+            }
+            x = ((x / freq) << probBits) + (x % freq) + cumFreqs[id];
+        }
+
+        // flush the states so that lane 0's comes first after reversal
+        for (int lane = numLanes; lane--;) {
+            output.push_back((uint32_t)state[lane]);
+            output.push_back((uint32_t)(state[lane] >> 32));
+        }
+        std::reverse(output.begin(), output.end());
+    }
+
+    unsigned int probBits;
+    /// Dense remapping of symbols to IDs, indexed by symbol value. -1 for symbols not seen.
+    std::vector<int> symbolIds;
+    /// The symbols by ID
+    std::vector<SymbolType> symbols;
+    std::vector<uint64_t> frequencies;
+    /// The symbol IDs in input order
+    std::vector<uint32_t> sequence;
+    /// Cumulative quantised frequencies, cumFreqs[id+1] - cumFreqs[id] is id's frequency
+    std::vector<uint32_t> cumFreqs;
+    /// The encoded stream, in decoding order
+    std::vector<uint32_t> output;
+};
@@ -5,7 +5,8 @@
 #include <iomanip>
 #include <vector>
 
-#include "Timer.h"
+#include "MergeProfile.h"
+#include "PhaseTimer.h"
 #include "TopDag.h"
 #include "Statistics.h"
 
@@ -48,12 +49,19 @@ public:
     /// \param verbose whether to print detailed information about the iterations
     /// \param extraVerbose whether to print the tree in each iteration
     RePairCombiner(TreeType &tree, TopDag<DataType> &topDag, const bool verbose = true, const bool extraVerbose = false)
-        : tree(tree), topDag(topDag), verbose(verbose), extraVerbose(extraVerbose), nodeIds(tree._numNodes), hasher(tree, topDag, nodeIds) {
+        : tree(tree), topDag(topDag), verbose(verbose), extraVerbose(extraVerbose), nodeIds(tree._numNodes), hasher(tree, topDag, nodeIds),
+          profile(NULL), numMerges(0) {
             for (int i = 0; i < tree._numNodes; ++i) {
                 nodeIds[i] = i;
             }
         }
 
+    /// Record a profile of each iteration during construct()
+    /// \param profile the profile to append to, or NULL
+    void setProfile(MergeProfile *profile) {
+        this->profile = profile;
+    }
+
     /// Perform the top tree construction procedure
     /// \param debugInfo pointer to a DebugInfo object, should you wish logging of debug information
     void construct(DebugInfo *debugInfo = NULL, const double minRatio = 1.2) {
@@ -64,6 +72,7 @@ protected:
     void mergeCallback(const int u, const int v, const int n, const MergeType type) {
         nodeIds[n] = topDag.addCluster(nodeIds[u], nodeIds[v], type);
         hasher.hashNode(n);
+        ++numMerges;
     }
 
 
@@ -77,16 +86,27 @@ protected:
     void doMerges(DebugInfo *debugInfo, const double minRatio = 1.2) {
 
         int iteration = 0;
-        Timer timer;
 
-        hasher.hashTree();
+        {
+            ScopedPhase hashing("hash");
+            hasher.hashTree();
+        }
 
         const std::streamsize precision = cout.precision();
-        cout << std::fixed << std::setprecision(1);
+        // only touch the shared stream's format when printing, other threads may be using it
+        if (verbose) cout << std::fixed << std::setprecision(1);
+        PhaseCounters phases;
         while (tree._numEdges > 1) {
+            ScopedPhase iterationPhase("iteration", iteration);
             if (verbose) cout << "It. " << std::setw(2) << iteration << ": merging horz… " << flush;
             if (extraVerbose) cout << endl << tree.shortString() << endl;
 
+            IterationProfile record;
+            record.iteration = iteration;
+            const size_t oldNumDagNodes = topDag.nodes.size();
+            uint64_t oldNumMerges = numMerges;
+            ScopedPhase horizontal("horz");
+
             // It is faster to reset all of them than flip the individual bits
             dirty.assign(tree._numNodes, false);
 
@@ -97,16 +117,33 @@ protected:
                 normalHorizontalMerges(iteration);
             }
             tree.killNodes();
-            if (verbose) cout << std::setw(6) << timer.getAndReset() << "ms; gc… " << flush;
+            phases.next(debugInfo == NULL ? NULL : &debugInfo->horizontalCounters);
+            record.horizontalTime = horizontal.stop();
+            record.horizontalMerges = numMerges - oldNumMerges;
+            oldNumMerges = numMerges;
+            if (verbose) cout << std::setw(6) << record.horizontalTime << "ms; gc… " << flush;
 
             // We need to compact here because the horizontal merges don't but
             // the vertical merges need correct edge counts, so this is important!
+            ScopedPhase compaction("gc");
             tree.inplaceCompact(dirty, false);
-            if (verbose) cout << std::setw(6) << timer.getAndReset() << "ms; vert… " << flush;
+            phases.next(debugInfo == NULL ? NULL : &debugInfo->compactCounters);
+            record.compactTime = compaction.stop();
+            if (verbose) cout << std::setw(6) << record.compactTime << "ms; vert… " << flush;
 
+            ScopedPhase vertical("vert");
             verticalMerges(iteration);
             tree.killNodes();
-            if (verbose) cout << std::setw(6) << timer.getAndReset() << " ms; " << tree.summary();
+            phases.next(debugInfo == NULL ? NULL : &debugInfo->verticalCounters);
+            record.verticalTime = vertical.stop();
+            record.verticalMerges = numMerges - oldNumMerges;
+            if (verbose) cout << std::setw(6) << record.verticalTime << " ms; " << tree.summary();
+
+            if (profile != NULL) {
+                record.dagNodesAdded = topDag.nodes.size() - oldNumDagNodes;
+                record.recordSizes(tree, topDag);
+                profile->iterations.push_back(record);
+            }
 
             double ratio = (oldNumEdges * 1.0) / tree._numEdges;
             if (verbose) cout << std::endl;
@@ -117,10 +154,12 @@ protected:
             tree.checkConsistency();
         }
         mergeCallback(0, tree.edges[tree.nodes[0].firstEdgeIndex].headNode, 0, VERT_WITH_BBN);
-        // reset the output stream
-        cout.unsetf(std::ios_base::fixed);
-        cout << std::setprecision(precision);
-        if (verbose) cout << tree.summary() << endl;
+        if (verbose) {
+            // reset the output stream
+            cout.unsetf(std::ios_base::fixed);
+            cout << std::setprecision(precision);
+            cout << tree.summary() << endl;
+        }
     }
 
 
@@ -307,4 +346,7 @@ protected:
     vector<int> nodeIds;
     NodeHasher<TreeType, DataType> hasher;
     vector<bool> dirty;
+    MergeProfile *profile;
+    /// the number of merges so far
+    uint64_t numMerges;
 };
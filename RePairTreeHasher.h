@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Labels.h"
+#include "Traversal.h"
 
 /// Hash a node for RePair combiner
 template <typename TreeType, typename DataType>
@@ -49,12 +50,8 @@ struct NodeHasher {
 
     /// Hash the entire tree in post-order
     void hashTree(const int nodeId = 0) {
-        for (auto *edge = tree.firstEdge(nodeId); edge <= tree.lastEdge(nodeId); ++edge) {
-            if (edge->valid) {
-                hashTree(edge->headNode);
-            }
-        }
-        hashNode(nodeId);
+        traverseTree(tree, nodeId, [](const int, const int) {},
+                     [&](const int id, const int) { hashNode(id); });
     }
 
     TreeType &tree;
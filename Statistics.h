@@ -1,43 +1,90 @@
 #pragma once
 
+#include <atomic>
 #include <iomanip>
+#include <memory>
 #include <mutex>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <type_traits>
 #include <vector>
 
-/// A completely thread-safe statistics writer
-// Uses locking for all operations, feel free to do crazy things with threads
-struct StatWriter {
-    void open(const std::string &filename) {
-        mutex.lock();
-        out.open(filename.c_str());
-        mutex.unlock();
+#include "HardwareCounters.h"
+#include "MemoryUsage.h"
+
+/// Collects statistics records from any number of threads and writes them to a file at the end
+/**
+ * Every thread appends to its own buffer, so writing a record takes no lock
+ * and doesn't touch the file. A thread's buffer is registered (under a lock)
+ * the first time it writes to a writer. close() writes all buffers, either as
+ * text (one record per line, using operator<<) or, if the filename ends in
+ * ".bin", as raw binary records. It must not run concurrently with write().
+ */
+template <typename T>
+class StatWriter {
+public:
+    StatWriter() : mutex(), buffers(), filename(), header(), enabled(false) {}
+
+    /// Start collecting records
+    /// \param filename the output file
+    /// \param header a line to write before the records in text mode
+    void open(const std::string &filename, const std::string &header = "") {
+        this->filename = filename;
+        this->header = header;
+        enabled = true;
     }
 
+    /// Write all records collected so far and stop collecting
     void close() {
-        mutex.lock();
-        if (out.is_open())
-            out.close();
-        mutex.unlock();
+        if (!enabled) return;
+        enabled = false;
+        const bool binary = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+        std::ofstream out(filename.c_str(), binary ? std::ios::out | std::ios::binary : std::ios::out);
+        if (!binary) out << header;
+        for (const std::unique_ptr<std::vector<T>> &buffer : buffers) {
+            if (binary) {
+                static_assert(std::is_trivially_copyable<T>::value, "records must be trivially copyable");
+                out.write(reinterpret_cast<const char *>(buffer->data()), buffer->size() * sizeof(T));
+            } else {
+                for (const T &record : *buffer) {
+                    out << record << '\n';
+                }
+            }
+            buffer->clear();
+        }
     }
 
-    template <typename T>
-    void write(const T &data, const bool newLine = true) {
-        mutex.lock();
-        if (out.is_open()) {
-            out << data;
-            if (newLine)
-                out << std::endl;
+    /// Add a record (does nothing unless the writer is open)
+    void write(const T &record) {
+        if (!enabled.load(std::memory_order_relaxed)) return;
+        localBuffer().push_back(record);
+    }
+
+protected:
+    /// The calling thread's buffer
+    std::vector<T> &localBuffer() {
+        // cache the buffer for the last writer this thread used
+        static thread_local const StatWriter *owner = nullptr;
+        static thread_local std::vector<T> *buffer = nullptr;
+        if (owner != this) {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.emplace_back(new std::vector<T>());
+            buffer = buffers.back().get();
+            owner = this;
         }
-        mutex.unlock();
+        return *buffer;
     }
 
     std::mutex mutex;
-    std::ofstream out;
+    /// the threads' buffers, which outlive the threads
+    std::vector<std::unique_ptr<std::vector<T>>> buffers;
+    std::string filename;
+    std::string header;
+    std::atomic<bool> enabled;
 };
 
-static StatWriter edgeRatioWriter;
-static StatWriter debugInfoWriter;
+static StatWriter<double> edgeRatioWriter;
 
 /// Holds debug information about a tree compression run
 struct DebugInfo {
@@ -75,6 +122,12 @@ struct DebugInfo {
     uint_fast64_t height;
     /// average depth of the tree's nodes
     double avgDepth;
+    /// hardware events of the construction phases and of unpacking (see HardwareCounters)
+    CounterValues horizontalCounters, compactCounters, verticalCounters, unpackCounters;
+    /// number of nodes in the input tree
+    uint_fast64_t numNodes;
+    /// memory usage of generating (or parsing) the tree, top tree construction, the DAG, and unpacking (see MemoryUsage)
+    MemoryValues generationMemory, mergeMemory, dagMemory, unpackMemory;
 
     DebugInfo()
         : generationDuration(0.0),
@@ -93,7 +146,16 @@ struct DebugInfo {
           topTreeMinDepth(0),
           topTreeAvgDepth(0.0),
           height(0),
-          avgDepth(0.0) {}
+          avgDepth(0.0),
+          horizontalCounters(),
+          compactCounters(),
+          verticalCounters(),
+          unpackCounters(),
+          numNodes(0),
+          generationMemory(),
+          mergeMemory(),
+          dagMemory(),
+          unpackMemory() {}
 
     /// the total time it took to perform the relevant (i.e., non-statistical) operations
     double totalDuration() const {
@@ -135,6 +197,15 @@ struct DebugInfo {
         topTreeAvgDepth += other.topTreeAvgDepth;
         height += other.height;
         avgDepth += other.avgDepth;
+        horizontalCounters += other.horizontalCounters;
+        compactCounters += other.compactCounters;
+        verticalCounters += other.verticalCounters;
+        unpackCounters += other.unpackCounters;
+        numNodes += other.numNodes;
+        generationMemory += other.generationMemory;
+        mergeMemory += other.mergeMemory;
+        dagMemory += other.dagMemory;
+        unpackMemory += other.unpackMemory;
     }
 
     /// calculate element-wise minimum with another DebugInfo object in-place
@@ -154,6 +225,15 @@ struct DebugInfo {
         topTreeAvgDepth = std::min(topTreeAvgDepth, other.topTreeAvgDepth);
         height = std::min(height, other.height);
         avgDepth = std::min(avgDepth, other.avgDepth);
+        horizontalCounters.min(other.horizontalCounters);
+        compactCounters.min(other.compactCounters);
+        verticalCounters.min(other.verticalCounters);
+        unpackCounters.min(other.unpackCounters);
+        numNodes = std::min(numNodes, other.numNodes);
+        generationMemory.min(other.generationMemory);
+        mergeMemory.min(other.mergeMemory);
+        dagMemory.min(other.dagMemory);
+        unpackMemory.min(other.unpackMemory);
     }
 
     /// calculate element-wise maximum with another DebugInfo object in-place
@@ -164,7 +244,7 @@ struct DebugInfo {
         unpackDuration = std::max(unpackDuration, other.unpackDuration);
         ioDuration = std::max(ioDuration, other.ioDuration);
         statDuration = std::max(statDuration, other.statDuration);
-        minEdgeRatio = std::max(maxEdgeRatio, other.maxEdgeRatio);
+        maxEdgeRatio = std::max(maxEdgeRatio, other.maxEdgeRatio);
         iterations = std::max(iterations, other.iterations);
         numDagEdges = std::max(numDagEdges, other.numDagEdges);
         numDagNodes = std::max(numDagNodes, other.numDagNodes);
@@ -173,6 +253,15 @@ struct DebugInfo {
         topTreeAvgDepth = std::max(topTreeAvgDepth, other.topTreeAvgDepth);
         height = std::max(height, other.height);
         avgDepth = std::max(avgDepth, other.avgDepth);
+        horizontalCounters.max(other.horizontalCounters);
+        compactCounters.max(other.compactCounters);
+        verticalCounters.max(other.verticalCounters);
+        unpackCounters.max(other.unpackCounters);
+        numNodes = std::max(numNodes, other.numNodes);
+        generationMemory.max(other.generationMemory);
+        mergeMemory.max(other.mergeMemory);
+        dagMemory.max(other.dagMemory);
+        unpackMemory.max(other.unpackMemory);
     }
 
     /// divide all (reasonable) elements for statistics aggregation
@@ -187,9 +276,18 @@ struct DebugInfo {
         numDagNodes /= factor;
         topTreeAvgDepth /= factor;
         avgDepth /= factor;
+        horizontalCounters.divide(factor);
+        compactCounters.divide(factor);
+        verticalCounters.divide(factor);
+        unpackCounters.divide(factor);
+        numNodes /= factor;
+        generationMemory.divide(factor);
+        mergeMemory.divide(factor);
+        dagMemory.divide(factor);
+        unpackMemory.divide(factor);
     }
 
-    /// Dump this debugInfo object to an output stream (tab-separated values)
+    /// Dump this debugInfo object to an output stream (tab-separated values, without a line break)
     void dump(std::ostream &os) const {
         os << totalDuration() << "\t"
            << generationDuration << "\t"
@@ -208,8 +306,20 @@ struct DebugInfo {
            << topTreeMinDepth << "\t"
            << topTreeAvgDepth << "\t"
            << height << "\t"
-           << avgDepth
-           << std::endl;
+           << avgDepth;
+        if (HardwareCounters::isEnabled()) {
+            for (const CounterValues *counters : {&horizontalCounters, &compactCounters, &verticalCounters, &unpackCounters}) {
+                os << "\t";
+                counters->dump(os);
+            }
+        }
+        if (MemoryUsage::isEnabled()) {
+            os << "\t" << numNodes;
+            for (const MemoryValues *memory : {&generationMemory, &mergeMemory, &dagMemory, &unpackMemory}) {
+                os << "\t";
+                memory->dump(os);
+            }
+        }
     }
 
     /// Write an explanative header (tab-separated)
@@ -231,7 +341,21 @@ struct DebugInfo {
            << "topTreeMinDepth" << "\t"
            << "topTreeAvgDepth" << "\t"
            << "height" << "\t"
-           << "avgDepth" << std::endl;
+           << "avgDepth";
+        if (HardwareCounters::isEnabled()) {
+            for (const char *phase : {"horizontal", "compact", "vertical", "unpack"}) {
+                os << "\t";
+                CounterValues::dumpHeader(os, phase);
+            }
+        }
+        if (MemoryUsage::isEnabled()) {
+            os << "\t" << "numNodes";
+            for (const char *phase : {"generation", "merge", "dag", "unpack"}) {
+                os << "\t";
+                MemoryValues::dumpHeader(os, phase);
+            }
+        }
+        os << std::endl;
     }
 
     friend std::ostream& operator<<(std::ostream &os, const DebugInfo &info) {
@@ -240,20 +364,29 @@ struct DebugInfo {
     }
 };
 
+static StatWriter<DebugInfo> debugInfoWriter;
+
 /// A statistics aggregator
 struct Statistics {
-    Statistics(const std::string &edgeRatioFilename = "", const std::string &debugInfoFilename = "") : numDebugInfos(0) {
+    /// Create an aggregator. If output files are given, it collects the edge
+    /// ratios and debug infos of all threads and writes them when destroyed.
+    Statistics(const std::string &edgeRatioFilename = "", const std::string &debugInfoFilename = "")
+        : numDebugInfos(0), ownsWriters(edgeRatioFilename != "" || debugInfoFilename != "") {
         if (edgeRatioFilename != "") {
             edgeRatioWriter.open(edgeRatioFilename);
         }
         if (debugInfoFilename != "") {
-            debugInfoWriter.open(debugInfoFilename);
-            DebugInfo::dumpHeader(debugInfoWriter.out);
+            std::ostringstream header;
+            DebugInfo::dumpHeader(header);
+            debugInfoWriter.open(debugInfoFilename, header.str());
         }
     }
 
     ~Statistics() {
-        edgeRatioWriter.close();
+        if (ownsWriters) {
+            edgeRatioWriter.close();
+            debugInfoWriter.close();
+        }
     }
 
     /// add a debug info object
@@ -267,10 +400,25 @@ struct Statistics {
             max.max(info);
             avg.add(info);
         }
-        debugInfoWriter.write(info, false);
+        debugInfoWriter.write(info);
         ++numDebugInfos;
     }
 
+    /// add all debug info objects of another aggregator (e.g., another thread's)
+    void merge(const Statistics &other) {
+        if (other.numDebugInfos == 0) return;
+        if (numDebugInfos == 0) {
+            min = other.min;
+            max = other.max;
+            avg = other.avg;
+        } else {
+            min.min(other.min);
+            max.max(other.max);
+            avg.add(other.avg);
+        }
+        numDebugInfos += other.numDebugInfos;
+    }
+
     void compute() {
         avg.divide(numDebugInfos);
     }
@@ -303,9 +451,38 @@ struct Statistics {
            << "Top T min depth: " << avg.topTreeMinDepth * 1.0 / numDebugInfos << " (avg), " << min.topTreeMinDepth << " (min), " << max.topTreeMinDepth << " (max)" << std::endl
            << "Tree height:     " << avg.height * 1.0 / numDebugInfos << " (avg), " << min.height << " (min), " << max.height << " (max)" << std::endl
            << "Avg node depth:  " << avg.avgDepth << " (avg), " << min.avgDepth << " (min), " << max.avgDepth << " (max)" << std::endl;
+        if (HardwareCounters::isEnabled()) {
+            os << std::endl << "Hardware counters (avg):" << std::endl;
+            dumpCounters(os, "Horizontal merges: ", avg.horizontalCounters);
+            dumpCounters(os, "Compaction:        ", avg.compactCounters);
+            dumpCounters(os, "Vertical merges:   ", avg.verticalCounters);
+            dumpCounters(os, "Unpacking:         ", avg.unpackCounters);
+        }
+        if (MemoryUsage::isEnabled()) {
+            os << std::endl << "Memory (avg; peak is the max. over all trees):" << std::endl;
+            dumpMemory(os, "Tree generation:  ", avg.generationMemory, max.generationMemory, avg.numNodes);
+            dumpMemory(os, "Top DAG construct:", avg.mergeMemory, max.mergeMemory, avg.numNodes);
+            // the phases that weren't run have no resident set size
+            if (max.dagMemory.residentBytes > 0)
+                dumpMemory(os, "Top DAG stats:    ", avg.dagMemory, max.dagMemory, avg.numNodes);
+            if (max.unpackMemory.residentBytes > 0)
+                dumpMemory(os, "Unpacking:        ", avg.unpackMemory, max.unpackMemory, avg.numNodes);
+        }
+    }
+
+    static void dumpCounters(std::ostream &os, const std::string &name, const CounterValues &counters) {
+        os << name << counters.cycles << " cycles, " << counters.ipc() << " IPC, " << counters.llcMisses
+           << " LLC misses, " << counters.branchMisses << " branch misses" << std::endl;
+    }
+
+    static void dumpMemory(std::ostream &os, const std::string &name, const MemoryValues &avg, const MemoryValues &max, const uint_fast64_t numNodes) {
+        os << name << " " << avg.peakBytes / 1048576.0 << " MiB (peak " << max.peakBytes / 1048576.0 << " MiB), "
+           << (avg.peakBytes * 1.0) / std::max<uint_fast64_t>(1, numNodes) << " bytes/node, "
+           << avg.allocations << " allocations, RSS " << max.residentBytes / 1048576.0 << " MiB" << std::endl;
     }
 
     DebugInfo min, max, avg;
-    std::ofstream out;
     uint numDebugInfos;
+    /// whether this aggregator opened the writers, and thus closes them
+    bool ownsWriters;
 };
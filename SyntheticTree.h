@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "BPString.h"
+#include "Common.h"
+
+/// Shape parameters of synthetic trees, see SyntheticTreeGenerator
+struct SyntheticTreeParameters {
+    /// Distributions of the number of children
+    enum FanoutDistribution {
+        FIXED,     ///< always `meanFanout` children
+        GEOMETRIC, ///< geometric with mean `meanFanout`
+        POWER_LAW  ///< P(k) proportional to (k + 1)^(-fanoutExponent) for k <= maxFanout
+    };
+
+    FanoutDistribution fanoutDistribution;
+    double meanFanout;
+    double fanoutExponent;
+    int maxFanout;
+
+    /// Nodes deeper than this are leaves
+    int maxDepth;
+    /// A node at depth d is forced to be a leaf with probability 1 - depthDecay^d
+    double depthDecay;
+    /// Probability that a node has exactly one child, regardless of the fanout distribution
+    double chainProbability;
+
+    /// Probability that a child subtree is a copy of an earlier subtree
+    double repetitionRate;
+    /// Depth of the subtrees that can be copied, or -1 for any depth
+    int templateDepth;
+    /// Maximum number of nodes of subtrees that can be copied
+    int maxTemplateSize;
+    /// Number of subtrees kept for copying
+    int numTemplates;
+    /// Probability that a copied node gets a fresh label
+    double mutationRate;
+
+    /// Number of different labels
+    int numLabels;
+    /// Labels are drawn with probability proportional to (i + 1)^(-labelExponent), 0 is uniform
+    double labelExponent;
+
+    SyntheticTreeParameters()
+        : fanoutDistribution(GEOMETRIC), meanFanout(2), fanoutExponent(2), maxFanout(1000), maxDepth(1000),
+          depthDecay(1), chainProbability(0), repetitionRate(0), templateDepth(-1), maxTemplateSize(100),
+          numTemplates(16), mutationRate(0), numLabels(2), labelExponent(0) {}
+
+    /// Set the parameters to a named workload
+    /**
+     * - `dblp`: a wide root with shallow records that are mostly copies of a few templates
+     * - `treebank`: deep sentences with skewed fanout, chains of unary nodes, and some repeated phrases
+     * - `chains`: long unary chains with occasional branching
+     * - `repetitive`: geometric fanout where most subtrees repeat earlier ones
+     *
+     * \param name the workload name
+     * \param numLabels the number of different labels
+     * \returns whether the name is known
+     */
+    bool setWorkload(const std::string &name, const int numLabels) {
+        *this = SyntheticTreeParameters();
+        this->numLabels = numLabels;
+        if (name == "dblp") {
+            fanoutDistribution = GEOMETRIC;
+            meanFanout = 6;
+            maxDepth = 3;
+            depthDecay = 0.5;
+            repetitionRate = 0.95;
+            templateDepth = 1;
+            maxTemplateSize = 50;
+            numTemplates = 6;
+            mutationRate = 0.01;
+            labelExponent = 1;
+        } else if (name == "treebank") {
+            fanoutDistribution = POWER_LAW;
+            fanoutExponent = 1.5;
+            maxFanout = 12;
+            maxDepth = 60;
+            depthDecay = 0.97;
+            chainProbability = 0.3;
+            repetitionRate = 0.4;
+            maxTemplateSize = 12;
+            numTemplates = 64;
+            mutationRate = 0.05;
+            labelExponent = 1.2;
+        } else if (name == "chains") {
+            fanoutDistribution = GEOMETRIC;
+            meanFanout = 2;
+            chainProbability = 0.9;
+            maxDepth = 100000;
+        } else if (name == "repetitive") {
+            fanoutDistribution = GEOMETRIC;
+            meanFanout = 2;
+            maxDepth = 40;
+            depthDecay = 0.95;
+            repetitionRate = 0.7;
+            maxTemplateSize = 200;
+            numTemplates = 32;
+        } else {
+            return false;
+        }
+        return true;
+    }
+};
+
+/// Generates labelled ordered trees resembling real documents
+/**
+ * Unlike RandomTreeGenerator, the trees are not uniform. They are grown in
+ * preorder: each new node draws its number of children from the fanout
+ * distribution, subject to the depth profile. Each child is either a fresh
+ * node or, with probability `repetitionRate`, a copy of an earlier complete
+ * subtree from a pool of templates (replacing a random one when the pool is
+ * full). When the root's children are exhausted before the tree has its size,
+ * the root gets more children. When the size is reached, all open nodes are
+ * closed.
+ *
+ * The tree is written as a balanced parenthesis sequence, so copying a subtree
+ * copies a range of it, and built with BPString::buildTree. All randomness
+ * comes from the given generator.
+ */
+template <typename RNG>
+class SyntheticTreeGenerator {
+public:
+    /// Create a synthetic tree generator
+    /// \param gen the random generator to use
+    /// \param parameters the shape of the trees
+    SyntheticTreeGenerator(RNG &gen, const SyntheticTreeParameters &parameters)
+        : generator(gen), parameters(parameters), powerLawFanout(), labelDistribution(), templates(),
+          rootNode{0, 0, 0, 0} {
+        if (parameters.fanoutDistribution == SyntheticTreeParameters::POWER_LAW) {
+            const std::vector<double> fanoutWeights = powerLawWeights(parameters.maxFanout + 1, parameters.fanoutExponent);
+            powerLawFanout = std::discrete_distribution<int>(fanoutWeights.begin(), fanoutWeights.end());
+        }
+        const std::vector<double> labelWeights = powerLawWeights(std::max(1, parameters.numLabels), parameters.labelExponent);
+        labelDistribution = std::discrete_distribution<int>(labelWeights.begin(), labelWeights.end());
+    }
+
+    /// Generate a labelled tree
+    /// \param tree an empty tree, its nodes are numbered in preorder
+    /// \param labels the nodes' labels
+    /// \param numEdges the number of edges that the tree shall have
+    template <typename TreeType>
+    void generateTree(TreeType &tree, std::vector<int> &labels, const int numEdges) {
+        const int numNodes = numEdges + 1;
+        std::vector<bool> bp;
+        bp.reserve(2 * (size_t)numNodes);
+        labels.clear();
+        labels.reserve(numNodes);
+        templates.clear();
+
+        // the open nodes
+        std::vector<OpenNode> path;
+        openNode(bp, labels, path, numNodes);
+        while ((int)labels.size() < numNodes) {
+            if (path.empty()) {
+                // give the root another child
+                path.push_back(rootNode);
+                path.back().remainingChildren = 1;
+                bp.pop_back();
+            }
+            OpenNode &node = path.back();
+            if (node.remainingChildren == 0) {
+                closeNode(bp, labels, path);
+                continue;
+            }
+            --node.remainingChildren;
+            if (!copyTemplate(bp, labels, path.size(), numNodes - labels.size())) {
+                openNode(bp, labels, path, numNodes);
+            }
+        }
+        while (!path.empty()) {
+            closeNode(bp, labels, path);
+        }
+        assert(bp.size() == 2 * (size_t)numNodes);
+
+        __attribute__((unused)) // to make compiler happy when assertions are disabled
+        const bool valid = BPString::buildTree(tree, bp.size(), [&](const size_t i) {
+            return bp[i] == BPString::OPEN;
+        });
+        assert(valid);
+    }
+
+protected:
+    struct OpenNode {
+        int depth;
+        int remainingChildren;
+        /// position of the opening parenthesis and of the label
+        size_t bpStart, labelStart;
+    };
+
+    /// A complete subtree that can be copied
+    struct Template {
+        size_t bpStart, labelStart;
+        int size;
+    };
+
+    /// Start a fresh node as a child of the innermost open node
+    void openNode(std::vector<bool> &bp, std::vector<int> &labels, std::vector<OpenNode> &path, const int numNodes) {
+        const int depth = path.size();
+        const int fanout = std::min(drawFanout(depth), numNodes - (int)labels.size() - 1);
+        path.push_back(OpenNode{depth, fanout, bp.size(), labels.size()});
+        if (depth == 0) rootNode = path.back();
+        bp.push_back(BPString::OPEN);
+        labels.push_back(drawLabel());
+    }
+
+    /// Close the innermost open node, keeping its subtree as a template if it qualifies
+    void closeNode(std::vector<bool> &bp, std::vector<int> &labels, std::vector<OpenNode> &path) {
+        const OpenNode &node = path.back();
+        bp.push_back(BPString::CLOSE);
+        const int size = labels.size() - node.labelStart;
+        if (node.depth > 0 && size <= parameters.maxTemplateSize && parameters.repetitionRate > 0 &&
+            (parameters.templateDepth < 0 || node.depth == parameters.templateDepth)) {
+            const Template subtree{node.bpStart, node.labelStart, size};
+            if ((int)templates.size() < parameters.numTemplates) {
+                templates.push_back(subtree);
+            } else {
+                std::uniform_int_distribution<int> index(0, parameters.numTemplates - 1);
+                templates[index(generator)] = subtree;
+            }
+        }
+        if (node.depth == 0) rootNode = node;
+        path.pop_back();
+    }
+
+    /// Possibly copy a random template as a child of the innermost open node
+    /// \returns whether a template was copied
+    bool copyTemplate(std::vector<bool> &bp, std::vector<int> &labels, const int depth, const int remainingNodes) {
+        if (templates.empty() || parameters.repetitionRate <= 0 ||
+            (parameters.templateDepth >= 0 && depth != parameters.templateDepth)) {
+            return false;
+        }
+        std::bernoulli_distribution repeat(parameters.repetitionRate);
+        if (!repeat(generator)) return false;
+        std::uniform_int_distribution<int> index(0, templates.size() - 1);
+        const Template subtree = templates[index(generator)];
+        if (subtree.size > remainingNodes) return false;
+
+        std::bernoulli_distribution mutate(parameters.mutationRate);
+        for (size_t i = 0; i < 2 * (size_t)subtree.size; ++i) {
+            bp.push_back(bp[subtree.bpStart + i]);
+        }
+        for (int i = 0; i < subtree.size; ++i) {
+            const int label = labels[subtree.labelStart + i];
+            labels.push_back(mutate(generator) ? drawLabel() : label);
+        }
+        return true;
+    }
+
+    /// Draw the number of children of a fresh node
+    int drawFanout(const int depth) {
+        if (depth >= parameters.maxDepth) return 0;
+        std::uniform_real_distribution<double> uniform(0, 1);
+        if (parameters.depthDecay < 1 && uniform(generator) >= std::pow(parameters.depthDecay, depth)) {
+            return 0;
+        }
+        if (parameters.chainProbability > 0 && uniform(generator) < parameters.chainProbability) {
+            return 1;
+        }
+        switch (parameters.fanoutDistribution) {
+        case SyntheticTreeParameters::FIXED:
+            return std::lround(parameters.meanFanout);
+        case SyntheticTreeParameters::GEOMETRIC: {
+            std::geometric_distribution<int> fanout(1 / (1 + parameters.meanFanout));
+            return std::min(fanout(generator), parameters.maxFanout);
+        }
+        case SyntheticTreeParameters::POWER_LAW:
+            return powerLawFanout(generator);
+        default:
+            assert(false);
+            return 0;
+        }
+    }
+
+    int drawLabel() {
+        return labelDistribution(generator);
+    }
+
+    /// Weights proportional to (i + 1)^(-exponent) for 0 <= i < n
+    static std::vector<double> powerLawWeights(const int n, const double exponent) {
+        std::vector<double> weights(n);
+        for (int i = 0; i < n; ++i) {
+            weights[i] = std::pow(i + 1.0, -exponent);
+        }
+        return weights;
+    }
+
+    RNG &generator;
+    const SyntheticTreeParameters parameters;
+    std::discrete_distribution<int> powerLawFanout;
+    std::discrete_distribution<int> labelDistribution;
+    std::vector<Template> templates;
+    /// the root, to reopen it when its children are exhausted early
+    OpenNode rootNode;
+};
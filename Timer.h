@@ -8,7 +8,9 @@
  *
  * TimeT is the precision of the timing, while scalingFactor
  * is the factor by which the output will be scaled. The default is to
- * return milliseconds with microsecond precision.
+ * return milliseconds with microsecond precision. It uses a monotonic clock,
+ * so durations aren't affected by changes of the system time. To time nested
+ * phases, see ScopedPhase in PhaseTimer.h.
  */
 template<typename TimeT = std::chrono::microseconds, int scalingFactor = 1000, typename ReturnType = double>
 struct TimerT {
@@ -17,11 +19,11 @@ struct TimerT {
     }
 
     void reset() {
-        start = std::chrono::system_clock::now();
+        start = std::chrono::steady_clock::now();
     }
 
     ReturnType get() const {
-        TimeT duration = std::chrono::duration_cast<TimeT>(std::chrono::system_clock::now() - start);
+        TimeT duration = std::chrono::duration_cast<TimeT>(std::chrono::steady_clock::now() - start);
         return (duration.count() * 1.0) / scalingFactor;
     }
 
@@ -32,7 +34,7 @@ struct TimerT {
     }
 
 private:
-    std::chrono::system_clock::time_point start;
+    std::chrono::steady_clock::time_point start;
 };
 
 /// A timer that is accurate to microseconds, formatted as milliseconds
@@ -6,6 +6,7 @@
 
 #include "Labels.h"
 #include "Nodes.h"
+#include "Traversal.h"
 
 using std::vector;
 
@@ -93,26 +94,24 @@ public:
         return count;
     }
 
-    /// Traverse the dag in post-order
-    /// \param callback a callback to be called with the node ID and the results of the calls to its children
-    template <typename T, typename Callback>
-    T inPostOrder(const Callback &callback) const {
-        return traverseDagPostOrder<T, Callback>(nodes.size() - 1, callback);
+    /// Approximate memory usage in bytes, including the hash table used during construction
+    size_t approximateBytes() const {
+        // a hash table node holds the value, the next pointer and the cached hash
+        return nodes.capacity() * sizeof(DagNode<DataType>) + clusterToDag.capacity() * sizeof(int) +
+               nodeMap.bucket_count() * sizeof(void *) +
+               nodeMap.size() * (sizeof(typename decltype(nodeMap)::value_type) + 2 * sizeof(void *));
     }
 
-    /// Helper for inPostOrder(), you shouldn't need to call this directly
+    /// Traverse the dag in post-order (shared nodes are visited once per reference)
+    /// \param callback a callback to be called with the node ID and the results of the calls to its children
     template <typename T, typename Callback>
-    T traverseDagPostOrder(const int nodeId, const Callback &callback) const {
-        assert(nodeId != 0); // 0 is the dummy not and should not be reachable
-        const DagNode<DataType> &node = nodes[nodeId];
-        T left(-1), right(-1);
-        if (node.left >= 0) {
-            left = traverseDagPostOrder<T, Callback>(node.left, callback);
-        }
-        if (node.right >= 0) {
-            right = traverseDagPostOrder<T, Callback>(node.right, callback);
-        }
-        return callback(nodeId, left, right);
+    T inPostOrder(const Callback &callback) const {
+        return foldBinaryPostOrder<T>(nodes.size() - 1,
+            [&](const int nodeId, int &left, int &right) {
+                assert(nodeId != 0); // 0 is the dummy not and should not be reachable
+                left = nodes[nodeId].left;
+                right = nodes[nodeId].right;
+            }, callback, T(-1));
     }
 
     friend std::ostream &operator<<(std::ostream &os, const TopDag<DataType> &dag) {
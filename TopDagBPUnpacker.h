@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "BPString.h"
+#include "Common.h"
+#include "TopDag.h"
+
+/// Unpack a Top DAG into a balanced parenthesis bitstring and a preorder label array
+/**
+ * Every cluster is written as a prefix and a suffix, with the bottom boundary
+ * node's children (the "hole") going in between. A leaf cluster's prefix is
+ * its node's opening parenthesis and label, its suffix the closing
+ * parenthesis. A cluster without a bottom boundary node is all prefix. The
+ * prefix (and the suffix) of a merged cluster are written contiguously:
+ *
+ *   vertical:   prefix = prefix(upper) prefix(lower), suffix = suffix(lower) suffix(upper)
+ *   horizontal: the parts are concatenated, the hole is in the part with the bbn
+ *
+ * If the merged cluster has no bbn, its suffix is appended to its prefix.
+ *
+ * Each DAG node is expanded only when it is first reached. The positions of its
+ * prefix and suffix in the output are recorded. Later references copy those
+ * ranges in bulk, 64 bits at a time for the parentheses and with memcpy for
+ * the labels.
+ *
+ * Parentheses are coded as in BPString: OPEN = 0, CLOSE = 1.
+ */
+template <typename DataType, typename DAGType = TopDag<DataType>>
+class TopDagBPUnpacker {
+public:
+    TopDagBPUnpacker(const DAGType &dag)
+        : dag(dag), words(), numBits(0), labels(), numLabels(0), segments(dag.nodes.size()),
+          hasSuffix(dag.nodes.size(), false), clusterSizes(dag.nodes.size(), 0), expandedBits(0), copiedBits(0) {
+        computeSuffixes();
+    }
+
+    void unpack() {
+        const int rootId = dag.nodes.size() - 1;
+        const long long numNodes = clusterSizes[rootId];
+        words.assign((2 * numNodes + 63) / 64 + 1, 0);
+        labels.resize(numNodes);
+        numBits = numLabels = 0;
+
+        writeCluster(rootId);
+        assert(numBits == (size_t)(2 * numNodes));
+        assert(numLabels == (size_t)numNodes);
+    }
+
+    /// Number of parentheses in the output
+    size_t size() const {
+        return numBits;
+    }
+
+    /// Get the parenthesis at a position (BPString::OPEN or BPString::CLOSE)
+    bool operator[](const size_t pos) const {
+        return (words[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    /// The nodes' labels in preorder
+    const std::vector<const DataType *> &getLabels() const {
+        return labels;
+    }
+
+    /// Convert to the same format as BPString::fromTree
+    void toBPString(std::vector<bool> &bpstring, std::vector<unsigned char> &labelNames) const {
+        bpstring.resize(numBits);
+        for (size_t i = 0; i < numBits; ++i) {
+            bpstring[i] = (*this)[i];
+        }
+        labelNames.clear();
+        for (const DataType *label : labels) {
+            std::copy(label->cbegin(), label->cend(), std::back_inserter(labelNames));
+            labelNames.push_back(0);
+        }
+    }
+
+    /// Number of parentheses that were generated by expanding the DAG
+    size_t getExpandedBits() const {
+        return expandedBits;
+    }
+
+    /// Number of parentheses that were copied from earlier occurrences
+    size_t getCopiedBits() const {
+        return copiedBits;
+    }
+
+protected:
+    /// Where a DAG node's prefix or suffix was first written
+    struct Range {
+        size_t bitStart;
+        size_t numBits;
+        size_t labelStart;
+        size_t numLabels;
+        Range() : bitStart(0), numBits(0), labelStart(0), numLabels(0) {}
+    };
+
+    struct Segments {
+        Range prefix;
+        Range suffix;
+        bool prefixWritten;
+        bool suffixWritten;
+        Segments() : prefix(), suffix(), prefixWritten(false), suffixWritten(false) {}
+    };
+
+    /// Determine the clusters' sizes and which clusters have a suffix (i.e., a bottom boundary node). This
+    /// isn't always given by the merge type: a vertical merge with a bbn whose lower
+    /// part has none (which happens at the root) doesn't have one either.
+    void computeSuffixes() {
+        // Nodes are stored in post-order, see DagSummaries
+        for (size_t nodeId = 1; nodeId < dag.nodes.size(); ++nodeId) {
+            const DagNode<DataType> node = dag.nodes[nodeId];
+            clusterSizes[nodeId] = (node.mergeType == NO_MERGE) ? 1 : clusterSizes[node.left] + clusterSizes[node.right];
+            switch (node.mergeType) {
+            case NO_MERGE:
+                hasSuffix[nodeId] = true;
+                break;
+            case VERT_WITH_BBN:
+            case HORZ_RIGHT_BBN:
+                hasSuffix[nodeId] = hasSuffix[node.right];
+                break;
+            case HORZ_LEFT_BBN:
+                hasSuffix[nodeId] = hasSuffix[node.left];
+                break;
+            default:
+                hasSuffix[nodeId] = false;
+            }
+        }
+    }
+
+    /// Write a whole cluster
+    void writeCluster(const int nodeId) {
+        writePrefix(nodeId);
+        if (hasSuffix[nodeId]) writeSuffix(nodeId);
+    }
+
+    void writePrefix(const int nodeId) {
+        Segments &segment = segments[nodeId];
+        if (segment.prefixWritten) {
+            copy(segment.prefix);
+            return;
+        }
+        const Range start = currentPosition();
+        const DagNode<DataType> node = dag.nodes[nodeId];
+        switch (node.mergeType) {
+        case NO_MERGE:
+            ++numBits; // OPEN
+            labels[numLabels++] = node.label;
+            ++expandedBits;
+            break;
+        case VERT_WITH_BBN:
+        case VERT_NO_BBN:
+            writePrefix(node.left);
+            writePrefix(node.right);
+            if (!hasSuffix[nodeId]) {
+                // close the lower part and the upper part's bbn
+                if (hasSuffix[node.right]) writeSuffix(node.right);
+                writeSuffix(node.left);
+            }
+            break;
+        case HORZ_LEFT_BBN:
+            writePrefix(node.left);
+            if (!hasSuffix[nodeId]) writeCluster(node.right);
+            break;
+        case HORZ_RIGHT_BBN:
+        case HORZ_NO_BBN:
+            writeCluster(node.left);
+            writePrefix(node.right);
+            if (!hasSuffix[nodeId] && hasSuffix[node.right]) writeSuffix(node.right);
+            break;
+        default:
+            assert(false);
+        }
+        finish(segment.prefix, start);
+        segment.prefixWritten = true;
+    }
+
+    void writeSuffix(const int nodeId) {
+        Segments &segment = segments[nodeId];
+        if (segment.suffixWritten) {
+            copy(segment.suffix);
+            return;
+        }
+        const Range start = currentPosition();
+        const DagNode<DataType> node = dag.nodes[nodeId];
+        assert(hasSuffix[nodeId]);
+        switch (node.mergeType) {
+        case NO_MERGE:
+            words[numBits / 64] |= (uint64_t)1 << (numBits % 64); // CLOSE
+            ++numBits;
+            ++expandedBits;
+            break;
+        case VERT_WITH_BBN:
+            writeSuffix(node.right);
+            writeSuffix(node.left);
+            break;
+        case HORZ_LEFT_BBN:
+            writeSuffix(node.left);
+            writeCluster(node.right);
+            break;
+        case HORZ_RIGHT_BBN:
+            writeSuffix(node.right);
+            break;
+        default:
+            assert(false);
+        }
+        finish(segment.suffix, start);
+        segment.suffixWritten = true;
+    }
+
+    Range currentPosition() const {
+        Range range;
+        range.bitStart = numBits;
+        range.labelStart = numLabels;
+        return range;
+    }
+
+    void finish(Range &range, const Range &start) const {
+        range = start;
+        range.numBits = numBits - start.bitStart;
+        range.numLabels = numLabels - start.labelStart;
+    }
+
+    /// Append a copy of an earlier part of the output
+    void copy(const Range &range) {
+        assert(range.bitStart + range.numBits <= numBits);
+        for (size_t done = 0; done < range.numBits; done += 64) {
+            const unsigned int length = std::min<size_t>(64, range.numBits - done);
+            appendBits(readBits(range.bitStart + done, length), length);
+        }
+        memcpy(labels.data() + numLabels, labels.data() + range.labelStart, range.numLabels * sizeof(const DataType *));
+        numLabels += range.numLabels;
+        copiedBits += range.numBits;
+    }
+
+    /// Read `length` <= 64 bits starting at position `pos`
+    uint64_t readBits(const size_t pos, const unsigned int length) const {
+        const unsigned int offset = pos % 64;
+        uint64_t bits = words[pos / 64] >> offset;
+        if (offset + length > 64) {
+            bits |= words[pos / 64 + 1] << (64 - offset);
+        }
+        return (length == 64) ? bits : (bits & (((uint64_t)1 << length) - 1));
+    }
+
+    /// Append `length` <= 64 bits (the output words after `numBits` are still zero)
+    void appendBits(const uint64_t bits, const unsigned int length) {
+        const unsigned int offset = numBits % 64;
+        words[numBits / 64] |= bits << offset;
+        if (offset + length > 64) {
+            words[numBits / 64 + 1] |= bits >> (64 - offset);
+        }
+        numBits += length;
+    }
+
+    const DAGType &dag;
+    std::vector<uint64_t> words;
+    size_t numBits;
+    std::vector<const DataType *> labels;
+    size_t numLabels;
+    /// Output positions of each DAG node's first expansion
+    std::vector<Segments> segments;
+    /// Whether a DAG node's cluster has a bottom boundary node, and thus a suffix
+    std::vector<bool> hasSuffix;
+    /// Number of tree nodes in each DAG node's cluster
+    std::vector<long long> clusterSizes;
+    size_t expandedBits;
+    size_t copiedBits;
+};
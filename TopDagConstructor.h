@@ -5,7 +5,8 @@
 #include <iomanip>
 #include <vector>
 
-#include "Timer.h"
+#include "MergeProfile.h"
+#include "PhaseTimer.h"
 #include "TopDag.h"
 #include "Statistics.h"
 
@@ -36,7 +37,14 @@ public:
     /// \param verbose whether to print detailed information about the iterations
     /// \param extraVerbose whether to print the tree in each iteration
     TopDagConstructor(TreeType &tree, TopDag<DataType> &topDag, const bool verbose = true, const bool extraVerbose = false)
-        : tree(tree), topDag(topDag), verbose(verbose), extraVerbose(extraVerbose), nodeIds(tree._numNodes) {}
+        : tree(tree), topDag(topDag), verbose(verbose), extraVerbose(extraVerbose), nodeIds(tree._numNodes),
+          profile(NULL), numMerges(0) {}
+
+    /// Record a profile of each iteration during construct()
+    /// \param profile the profile to append to, or NULL
+    void setProfile(MergeProfile *profile) {
+        this->profile = profile;
+    }
 
     /// Perform the top tree construction procedure
     /// \param debugInfo pointer to a DebugInfo object, should you wish logging of debug information
@@ -51,6 +59,7 @@ public:
 protected:
     void mergeCallback(const int u, const int v, const int n, const MergeType type) {
         nodeIds[n] = topDag.addCluster(nodeIds[u], nodeIds[v], type);
+        ++numMerges;
     }
 
     /// do iterated merges to construct a top tree
@@ -62,26 +71,47 @@ protected:
     /// \param extraVerbose whether to print the tree in each iteration
     void doMerges(DebugInfo *debugInfo) {
         int iteration = 0;
-        Timer timer;
         const std::streamsize precision = cout.precision();
-        cout << std::fixed << std::setprecision(1);
+        // only touch the shared stream's format when printing, other threads may be using it
+        if (verbose) cout << std::fixed << std::setprecision(1);
+        PhaseCounters phases;
         while (tree._numEdges > 1) {
+            ScopedPhase iterationPhase("iteration", iteration);
             if (verbose) cout << "It. " << std::setw(2) << iteration << ": merging horz… " << flush;
 
             if (extraVerbose) cout << endl << tree.shortString() << endl;
 
+            IterationProfile record;
+            record.iteration = iteration;
+            const size_t oldNumDagNodes = topDag.nodes.size();
+            uint64_t oldNumMerges = numMerges;
             int oldNumEdges = tree._numEdges;
+            ScopedPhase horizontal("horz");
 #ifdef SWEEP
             horizontalMergesAllPairs(iteration);
 #else
             horizontalMerges(iteration);
 #endif
             tree.killNodes();
-            if (verbose) cout << std::setw(6) << timer.getAndReset() << "ms; vert… " << flush;
+            phases.next(debugInfo == NULL ? NULL : &debugInfo->horizontalCounters);
+            record.horizontalTime = horizontal.stop();
+            record.horizontalMerges = numMerges - oldNumMerges;
+            oldNumMerges = numMerges;
+            if (verbose) cout << std::setw(6) << record.horizontalTime << "ms; vert… " << flush;
 
+            ScopedPhase vertical("vert");
             verticalMerges(iteration);
             tree.killNodes();
-            if (verbose) cout << std::setw(6) << timer.getAndReset() << " ms; " << tree.summary();
+            phases.next(debugInfo == NULL ? NULL : &debugInfo->verticalCounters);
+            record.verticalTime = vertical.stop();
+            record.verticalMerges = numMerges - oldNumMerges;
+            if (verbose) cout << std::setw(6) << record.verticalTime << " ms; " << tree.summary();
+
+            if (profile != NULL) {
+                record.dagNodesAdded = topDag.nodes.size() - oldNumDagNodes;
+                record.recordSizes(tree, topDag);
+                profile->iterations.push_back(record);
+            }
 
             double ratio = (oldNumEdges * 1.0) / tree._numEdges;
             if (verbose && ratio < 1.2) cout << " ratio " << std::setprecision(5) << ratio << std::setprecision(1) << std::endl << tree.shortString();
@@ -93,10 +123,12 @@ protected:
             tree.checkConsistency();
         }
         mergeCallback(0, tree.edges[tree.nodes[0].firstEdgeIndex].headNode, 0, VERT_WITH_BBN);
-        // reset the output stream
-        cout.unsetf(std::ios_base::fixed);
-        cout << std::setprecision(precision);
-        if (verbose) cout << tree.summary() << endl;
+        if (verbose) {
+            // reset the output stream
+            cout.unsetf(std::ios_base::fixed);
+            cout << std::setprecision(precision);
+            cout << tree.summary() << endl;
+        }
     }
 
     /// Do one iteration of horizontal merges (step 1)
@@ -259,4 +291,7 @@ protected:
     TopDag<DataType> &topDag;
     const bool verbose, extraVerbose;
     vector<int> nodeIds;
+    MergeProfile *profile;
+    /// the number of merges so far
+    uint64_t numMerges;
 };
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cassert>
+#include <vector>
+
+#include "Common.h"
+#include "DagSummary.h"
+#include "Labels.h"
+#include "TopDag.h"
+
+/// Unpack a Top DAG directly into an OrderedTree, without an intermediate TopTree
+/**
+ * The number of nodes and every node's number of children are known from the
+ * DAG summaries. This means the tree can be allocated up front and every node's
+ * outgoing edges can be placed in one contiguous block when the node is first
+ * reached as a top boundary node. The result is a compact tree (edges sorted
+ * by tail node in order of discovery, no gaps), so no edges are ever moved.
+ *
+ * Node IDs are assigned in the order in which the leaf clusters are reached,
+ * so they don't necessarily match the original tree's IDs. The root is always
+ * node 0. A cluster with `n` nodes and top fanout `f` uses `n` consecutive
+ * node IDs and allocates `n - f` consecutive edge slots for its nodes'
+ * children, so where each part of the cluster goes is known in advance and
+ * clusters can be unpacked independently of each other.
+ */
+template <typename TreeType, typename DataType, typename DAGType = TopDag<DataType>>
+class TopDagTreeUnpacker {
+public:
+    TopDagTreeUnpacker(const DAGType &dag, TreeType &tree, LabelsT<DataType> &labels)
+        : dag(dag), tree(tree), labels(labels), summaries(dag), boundaryIndex(dag.nodes.size(), -1) {
+        assert(tree._numNodes == 0);
+        computeBoundaryIndices();
+    }
+
+    void unpack() {
+        const int rootId = dag.nodes.size() - 1;
+        allocate(summaries[rootId].numNodes);
+
+        // the root cluster's top boundary node is a virtual node above the root
+        unpackCluster(Task(rootId, -1, 0, 0, 0, 1));
+    }
+
+protected:
+    /// Everything needed to unpack a cluster
+    struct Task {
+        /// the cluster's DAG node
+        int nodeId;
+        /// the tree node ID of the cluster's top boundary node, -1 for the virtual node above the root
+        int top;
+        /// the edge ID of the top boundary node's first outgoing edge in the cluster
+        long long firstEdge;
+        /// the tree node ID of the cluster's first node
+        int firstNode;
+        /// the first edge ID to allocate for the children of the cluster's nodes
+        long long firstChildEdge;
+
+        Task(int nodeId, int top, long long firstEdge, long long offset, int firstNode, long long firstChildEdge)
+            : nodeId(nodeId), top(top), firstEdge(firstEdge + offset), firstNode(firstNode), firstChildEdge(firstChildEdge) {}
+    };
+
+    /// Compute each cluster's bottom boundary node's index among the cluster's nodes
+    void computeBoundaryIndices() {
+        // Nodes are stored in post-order, see DagSummaries
+        for (size_t nodeId = 1; nodeId < dag.nodes.size(); ++nodeId) {
+            const DagNode<DataType> node = dag.nodes[nodeId];
+            switch (node.mergeType) {
+            case NO_MERGE:
+                boundaryIndex[nodeId] = 0;
+                break;
+            case VERT_WITH_BBN:
+            case HORZ_RIGHT_BBN:
+                if (boundaryIndex[node.right] >= 0) {
+                    boundaryIndex[nodeId] = summaries[node.left].numNodes + boundaryIndex[node.right];
+                }
+                break;
+            case HORZ_LEFT_BBN:
+                boundaryIndex[nodeId] = boundaryIndex[node.left];
+                break;
+            default:
+                boundaryIndex[nodeId] = -1;
+            }
+        }
+    }
+
+    /// Pre-size the tree for `numNodes` nodes and `numNodes - 1` edges
+    void allocate(const int numNodes) {
+        tree.nodes.resize(numNodes);
+        tree.edges.resize(numNodes);
+        for (auto &node : tree.nodes) {
+            // like a freshly added node without edges
+            node.firstEdgeIndex = numNodes;
+            node.lastEdgeIndex = numNodes - 1;
+        }
+        tree._numNodes = tree._firstFreeNode = numNodes;
+        tree._numEdges = numNodes - 1;
+        tree._firstFreeEdge = numNodes;
+    }
+
+    /// Unpack the cluster of a task completely
+    void unpackCluster(const Task &task) {
+        const DagNode<DataType> node = dag.nodes[task.nodeId];
+        if (node.mergeType == NO_MERGE) {
+            unpackLeaf(node, task);
+        } else {
+            Task left(task), right(task);
+            split(node, task, left, right);
+            unpackCluster(left);
+            unpackCluster(right);
+        }
+    }
+
+    /// Split a merged cluster's task into the tasks of its two parts. For vertical
+    /// merges, this allocates the children of the upper part's bottom boundary node.
+    void split(const DagNode<DataType> &node, const Task &task, Task &left, Task &right) {
+        const ClusterSummary &upper = summaries[node.left];
+        left = Task(node.left, task.top, task.firstEdge, 0, task.firstNode, task.firstChildEdge);
+        if (node.mergeType == VERT_WITH_BBN || node.mergeType == VERT_NO_BBN) {
+            const int boundaryNode = task.firstNode + boundaryIndex[node.left];
+            assert(boundaryIndex[node.left] >= 0);
+            // the lower part contains all of the boundary node's children
+            const long long childEdge = task.firstChildEdge + upper.numNodes - upper.topFanout;
+            const long long numChildren = summaries[node.right].topFanout;
+            tree.nodes[boundaryNode].firstEdgeIndex = childEdge;
+            tree.nodes[boundaryNode].lastEdgeIndex = childEdge + numChildren - 1;
+            right = Task(node.right, boundaryNode, childEdge, 0, task.firstNode + upper.numNodes,
+                         childEdge + numChildren);
+        } else {
+            right = Task(node.right, task.top, task.firstEdge, upper.topFanout, task.firstNode + upper.numNodes,
+                         task.firstChildEdge + upper.numNodes - upper.topFanout);
+        }
+    }
+
+    /// Add the leaf cluster's bottom node and its edge from the top boundary node
+    void unpackLeaf(const DagNode<DataType> &node, const Task &task) {
+        assert(node.label != NULL);
+        labels.set(task.firstNode, *node.label);
+        if (task.top >= 0) {
+            tree.nodes[task.firstNode].parent = task.top;
+            tree.edges[task.firstEdge].valid = true;
+            tree.edges[task.firstEdge].headNode = task.firstNode;
+        } else {
+            // Don't add the loop
+            assert(task.firstNode == 0);
+        }
+    }
+
+    const DAGType &dag;
+    TreeType &tree;
+    LabelsT<DataType> &labels;
+    DagSummaries<DataType, DAGType> summaries;
+    /// Index of each cluster's bottom boundary node among its nodes, -1 if it has none
+    std::vector<int> boundaryIndex;
+};
@@ -5,6 +5,7 @@
 
 #include "Nodes.h"
 #include "Labels.h"
+#include "Traversal.h"
 
 using std::cout;
 using std::endl;
@@ -41,20 +42,9 @@ struct TopTree {
     /// \param callback callback to call with the cluster ID as parameter
     template <typename Callback>
     void inPostOrder(const Callback &callback) {
-        traverseTreePostOrder(clusters.size() - 1, callback);
-    }
-
-    /// Helper for inPostOrder, you shouldn't need to use this
-    template <typename Callback>
-    void traverseTreePostOrder(const int clusterId, const Callback &callback) {
-        Cluster<DataType> &cluster = clusters[clusterId];
-        if (cluster.left != -1) {
-            traverseTreePostOrder(cluster.left, callback);
-        }
-        if (cluster.right != -1) {
-            traverseTreePostOrder(cluster.right, callback);
-        }
-        callback(clusterId);
+        traverseBinary(clusters.size() - 1, childGetter(),
+            [](const int, const int) {},
+            [&](const int clusterId, const int) { callback(clusterId); });
     }
 
     /// Traverse the top tree in post order, applying a callback to the callback results of its children
@@ -62,21 +52,16 @@ struct TopTree {
     /// \param initial value to use as "callback result" for leaves
     template <typename T, typename Callback>
     T foldPostOrder(const Callback &callback, const T initial) const {
-        return traverseFoldPostOrder(clusters.size() - 1, callback, initial);
+        return foldBinaryPostOrder<T>(clusters.size() - 1, childGetter(),
+            [&](const int, const T &left, const T &right) { return callback(left, right); }, initial);
     }
 
-    /// Helper function for foldPostOrder(). You should not need to use this directly.
-    template <typename T, typename Callback>
-    T traverseFoldPostOrder(const int clusterId, const Callback &callback, const T initial) const {
-        const Cluster<DataType> &cluster = clusters[clusterId];
-        T left(initial), right(initial);
-        if (cluster.left != -1) {
-            left = traverseFoldPostOrder(cluster.left, callback, initial);
-        }
-        if (cluster.right != -1) {
-            right = traverseFoldPostOrder(cluster.right, callback, initial);
-        }
-        return callback(left, right);
+    /// Children accessor for the traversals in Traversal.h
+    auto childGetter() const {
+        return [this](const int clusterId, int &left, int &right) {
+            left = clusters[clusterId].left;
+            right = clusters[clusterId].right;
+        };
     }
 
     /// Get the height of the top tree
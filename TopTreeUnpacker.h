@@ -1,9 +1,11 @@
 #pragma once
 
 #include <cassert>
+#include <vector>
 
 #include "Labels.h"
 #include "TopTree.h"
+#include "Traversal.h"
 
 /// Unpack a TopTree into its original OrderedTree
 template <typename TreeType, typename DataType>
@@ -37,88 +39,83 @@ private:
         labels.set(leafId, *label);
     }
 
+    /// Unpack a cluster whose top boundary node is `nodeId`
+    /// \returns the cluster's bottom boundary node, or -1 if it has none
     int unpackCluster(const int clusterId, const int nodeId) {
-        const Cluster<DataType> &cluster = topTree.clusters[clusterId];
-        __attribute__((unused)) // to make compiler happy when assertions are disabled
-        int leafId;
-        switch (cluster.mergeType) {
-        case VERT_NO_BBN:
+        // state of the clusters on the current path, indexed by depth
+        struct Frame {
+            int clusterId;
+            /// the cluster's top boundary node
+            int top;
+            /// the parts' bottom boundary nodes
+            int left, right;
+            bool leftDone;
+        };
+        std::vector<Frame> frames;
+        int result(-1);
+
+        traverseBinary(clusterId, topTree.childGetter(),
+            [&](const int id, const int depth) {
+                int top(nodeId);
+                if (depth > 0) {
+                    const Frame &parent = frames[depth - 1];
+                    const MergeType mergeType = topTree.clusters[parent.clusterId].mergeType;
+                    // the lower part of a vertical merge hangs off the upper part's bottom boundary node
+                    const bool isLower = parent.leftDone && (mergeType == VERT_WITH_BBN || mergeType == VERT_NO_BBN);
+                    top = isLower ? parent.left : parent.top;
+                }
+                frames.resize(depth + 1);
+                frames[depth] = Frame{id, top, -1, -1, false};
+            },
+            [&](const int id, const int depth) {
+                const Frame &frame = frames[depth];
+                if (isLeaf(id)) {
+                    if (id != 0) {
+                        tree.addEdge(frame.top, id, extraSpace);
+                    } else {
+                        // Don't add the loop
+                        assert(frame.top == 0);
+                    }
+                    handleLeaf(id);
+                    result = id;
+                } else {
+                    result = boundaryNode(topTree.clusters[id].mergeType, frame.left, frame.right);
+                    // Perform compaction because the OrderedTree data structure is really unsuitable
+                    // for decompression of the tree.
+                    if (tree._firstFreeEdge - tree._numEdges > 100000000) {
+                        tree.compact(true, 3);
+                    }
+                }
+
+                if (depth > 0) {
+                    Frame &parent = frames[depth - 1];
+                    if (!parent.leftDone) {
+                        parent.left = result;
+                        parent.leftDone = true;
+                    } else {
+                        parent.right = result;
+                    }
+                }
+            });
+
+        return result;
+    }
+
+    /// The bottom boundary node of a merged cluster, given those of its parts
+    static int boundaryNode(const MergeType mergeType, const int left, const int right) {
+        switch (mergeType) {
         case VERT_WITH_BBN:
-            leafId = unpackVertCluster(clusterId, nodeId);
-            break;
-        case HORZ_NO_BBN:
-        case HORZ_LEFT_BBN:
         case HORZ_RIGHT_BBN:
-            leafId = unpackHorzCluster(clusterId, nodeId);
-            break;
+            return right;
+        case HORZ_LEFT_BBN:
+            return left;
+        case VERT_NO_BBN:
+        case HORZ_NO_BBN:
+            return -1;
         default:
             assert(false);
-        }
-
-        // Perform compaction because the OrderedTree data structure is really unsuitable
-        // for decompression of the tree.
-        if (tree._firstFreeEdge - tree._numEdges > 100000000) {
-            tree.compact(true, 3);
-        }
-
-        return leafId;
-    }
-
-    int unpackVertCluster(const int clusterId, const int nodeId) {
-        const Cluster<DataType> &cluster = topTree.clusters[clusterId];
-        int boundaryNode(nodeId);
-        if (isLeaf(cluster.left)) {
-            if (cluster.left != 0) {
-                tree.addEdge(nodeId, cluster.left, extraSpace);
-            } else {
-                // Don't add the loop
-                assert(nodeId == 0);
-            }
-            handleLeaf(cluster.left);
-            boundaryNode = cluster.left;
-        } else {
-            boundaryNode = unpackCluster(cluster.left, nodeId);
-        }
-
-        if (isLeaf(cluster.right)) {
-            tree.addEdge(boundaryNode, cluster.right, extraSpace);
-            handleLeaf(cluster.right);
-            boundaryNode = cluster.right;
-        } else {
-            boundaryNode = unpackCluster(cluster.right, boundaryNode);
-        }
-
-        if (cluster.mergeType == VERT_WITH_BBN)
-            return boundaryNode;
-        else
             return -1;
-    }
-
-    int unpackHorzCluster(const int clusterId, const int nodeId) {
-        const Cluster<DataType> &cluster = topTree.clusters[clusterId];
-        int left, right;
-        if (isLeaf(cluster.left)) {
-            tree.addEdge(nodeId, cluster.left, extraSpace);
-            handleLeaf(cluster.left);
-            left = cluster.left;
-        } else {
-            left = unpackCluster(cluster.left, nodeId);
-        }
-
-        if (isLeaf(cluster.right)) {
-            tree.addEdge(nodeId, cluster.right, extraSpace);
-            handleLeaf(cluster.right);
-            right = cluster.right;
-        } else {
-            right = unpackCluster(cluster.right, nodeId);
         }
-
-        if (cluster.mergeType == HORZ_LEFT_BBN)
-            return left;
-        else if (cluster.mergeType == HORZ_RIGHT_BBN)
-            return right;
-        else
-            return -1;
     }
 
     TopTree<DataType> &topTree;
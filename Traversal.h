@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cassert>
+#include <vector>
+
+/*
+ * Iterative depth-first traversals with explicit stacks
+ *
+ * Trees and DAGs can be arbitrarily deep (think of a degenerate chain), so
+ * recursing over them overflows the call stack. These templates keep their
+ * state in a vector instead. All callbacks are template parameters, so they
+ * are inlined (unlike std::function).
+ */
+
+/// Depth-first traversal of a binary tree or DAG
+/// \param root ID of the node to start at
+/// \param children called as `children(id, left, right)`, must set `left` and `right`
+/// to the node's children's IDs, or -1 if it has none
+/// \param enter called as `enter(id, depth)` when a node is first reached (preorder)
+/// \param leave called as `leave(id, depth)` after both children have been left (postorder)
+template <typename Children, typename Enter, typename Leave>
+void traverseBinary(const int root, const Children &children, const Enter &enter, const Leave &leave) {
+    // state: 0 = enter left child next, 1 = enter right child next, 2 = leave
+    struct Frame {
+        int id, left, right, state;
+    };
+    std::vector<Frame> stack;
+    stack.push_back(Frame{root, -1, -1, 0});
+    children(root, stack.back().left, stack.back().right);
+    enter(root, 0);
+    while (!stack.empty()) {
+        Frame &frame = stack.back();
+        int next = -1;
+        if (frame.state == 0) {
+            next = frame.left;
+            frame.state = 1;
+        }
+        if (next < 0 && frame.state == 1) {
+            next = frame.right;
+            frame.state = 2;
+        }
+        if (next < 0) {
+            leave(frame.id, (int)stack.size() - 1);
+            stack.pop_back();
+            continue;
+        }
+        // `frame` is invalidated by the push
+        stack.push_back(Frame{next, -1, -1, 0});
+        children(next, stack.back().left, stack.back().right);
+        enter(next, (int)stack.size() - 1);
+    }
+}
+
+/// Bottom-up fold over a binary tree or DAG (shared nodes are visited once per reference)
+/// \param root ID of the node to start at
+/// \param children as for traverseBinary()
+/// \param callback called as `callback(id, leftResult, rightResult)` in postorder,
+/// where a missing child's result is `initial`
+/// \param initial result to use for missing children
+/// \returns the callback's result for the root
+template <typename T, typename Children, typename Callback>
+T foldBinaryPostOrder(const int root, const Children &children, const Callback &callback, const T &initial) {
+    std::vector<T> results;
+    traverseBinary(root, children,
+        [](const int, const int) {},
+        [&](const int id, const int) {
+            int left, right;
+            children(id, left, right);
+            T rightResult(initial), leftResult(initial);
+            if (right >= 0) {
+                rightResult = std::move(results.back());
+                results.pop_back();
+            }
+            if (left >= 0) {
+                leftResult = std::move(results.back());
+                results.pop_back();
+            }
+            results.push_back(callback(id, leftResult, rightResult));
+        });
+    assert(results.size() == 1);
+    return results.back();
+}
+
+/// Depth-first traversal of an OrderedTree
+/// \param tree the tree to traverse
+/// \param root ID of the node to start at
+/// \param enter called as `enter(id, depth)` when a node is first reached (preorder)
+/// \param leave called as `leave(id, depth)` after all of the node's children have been left (postorder)
+/// \param validOnly whether to skip invalid edges
+template <typename TreeType, typename Enter, typename Leave>
+void traverseTree(const TreeType &tree, const int root, const Enter &enter, const Leave &leave,
+                  const bool validOnly = true) {
+    typedef typename TreeType::edgeType EdgeType;
+    struct Frame {
+        int nodeId;
+        /// the next outgoing edge to follow, and the node's last one
+        const EdgeType *edge, *last;
+    };
+    // the frames of the nodes on the current path, stack[depth] is the current node's
+    std::vector<Frame> stack(64);
+    int depth(0);
+    stack[0] = Frame{root, tree.firstEdge(root), tree.lastEdge(root)};
+    enter(root, 0);
+    while (depth >= 0) {
+        Frame &frame = stack[depth];
+        while (frame.edge <= frame.last && validOnly && !frame.edge->valid) {
+            ++frame.edge;
+        }
+        if (frame.edge > frame.last) {
+            leave(frame.nodeId, depth);
+            --depth;
+            continue;
+        }
+        const int child = frame.edge->headNode;
+        ++frame.edge;
+        if (++depth == (int)stack.size()) {
+            // `frame` is invalidated by the resize
+            stack.resize(2 * stack.size());
+        }
+        stack[depth] = Frame{child, tree.firstEdge(child), tree.lastEdge(child)};
+        enter(child, depth);
+    }
+}
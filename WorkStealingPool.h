@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Runs batches of independent tasks on a fixed set of threads, balancing them by work stealing
+/**
+ * The worker threads are started once, by the constructor, and wait on a
+ * condition variable for the next batch, so a pool can be kept for a whole
+ * program and per-thread state (statistics buffers, phase timers, counters)
+ * is registered only once per worker. The calling thread works on every batch
+ * as thread 0.
+ *
+ * The tasks of a batch are numbered `0, ..., numTasks - 1` and initially dealt
+ * to the threads in contiguous ranges. Each thread works through its own range
+ * from the front. A thread whose range is empty steals the back half of the
+ * largest remaining range of another thread, so that threads that got short
+ * tasks help out those with long ones until all tasks are done.
+ *
+ * Every range has its own lock, which is only contended while a thread steals
+ * from it. No thread ever holds more than one lock. Tasks are passed the
+ * index of the thread running them, so callers can keep per-thread state
+ * (e.g., accumulators) without synchronisation and merge it afterwards.
+ *
+ * Only one batch runs at a time: run() must not be called concurrently or from
+ * within a task of the same pool. Use one pool per thread for nested batches.
+ */
+class WorkStealingPool {
+public:
+    /// \param numThreads number of threads, including the calling thread
+    explicit WorkStealingPool(const int numThreads)
+        : numThreads(std::max(1, numThreads)), ranges(this->numThreads), mutex(), batchReady(), batchDone(),
+          batch(0), numBusy(0), stopping(false), batchFunction(NULL), batchContext(NULL), workers() {
+        for (int i = 1; i < this->numThreads; ++i) {
+            workers.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        batchReady.notify_all();
+        for (std::thread &thread : workers) {
+            thread.join();
+        }
+    }
+
+    int getNumThreads() const {
+        return numThreads;
+    }
+
+    /// Run `f(task, threadId)` for every task in `[0, numTasks)` and wait for all of them
+    template <typename F>
+    void run(const size_t numTasks, const F &f) {
+        for (int i = 0; i < numThreads; ++i) {
+            ranges[i].begin = numTasks * i / numThreads;
+            ranges[i].end = numTasks * (i + 1) / numThreads;
+        }
+        if (numThreads == 1 || numTasks <= 1) {
+            // not worth waking the workers
+            work(0, &runTask<F>, &f);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batchFunction = &runTask<F>;
+            batchContext = &f;
+            numBusy = numThreads - 1;
+            ++batch;
+        }
+        batchReady.notify_all();
+        work(0, &runTask<F>, &f);
+        std::unique_lock<std::mutex> lock(mutex);
+        batchDone.wait(lock, [&]() { return numBusy == 0; });
+    }
+
+protected:
+    /// The tasks `[begin, end)` that are left to a thread
+    struct Range {
+        std::mutex mutex;
+        size_t begin, end;
+        Range() : mutex(), begin(0), end(0) {}
+    };
+
+    /// Calls a batch's function, passed as `context`, on a task
+    typedef void (*TaskFunction)(const void *context, size_t task, int threadId);
+
+    template <typename F>
+    static void runTask(const void *context, const size_t task, const int threadId) {
+        (*static_cast<const F *>(context))(task, threadId);
+    }
+
+    /// Work on the current batch until no tasks are left
+    void work(const int threadId, const TaskFunction function, const void *functionContext) {
+        size_t task;
+        while (take(threadId, task)) {
+            function(functionContext, task, threadId);
+        }
+    }
+
+    /// Wait for batches and work on them until the pool is destroyed
+    void workerLoop(const int threadId) {
+        uint64_t lastBatch(0);
+        while (true) {
+            TaskFunction function;
+            const void *functionContext;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                batchReady.wait(lock, [&]() { return stopping || batch != lastBatch; });
+                if (stopping) return;
+                lastBatch = batch;
+                function = batchFunction;
+                functionContext = batchContext;
+            }
+            work(threadId, function, functionContext);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--numBusy > 0) continue;
+            }
+            batchDone.notify_one();
+        }
+    }
+
+    /// Take the next task from the own range, or steal some
+    /// \returns false if there are no tasks left
+    bool take(const int threadId, size_t &task) {
+        Range &own = ranges[threadId];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (own.begin < own.end) {
+                task = own.begin++;
+                return true;
+            }
+        }
+        while (true) {
+            // find the largest range
+            int victim(-1);
+            size_t largest(0);
+            for (int i = 0; i < (int)ranges.size(); ++i) {
+                if (i == threadId) continue;
+                std::lock_guard<std::mutex> lock(ranges[i].mutex);
+                if (ranges[i].end - ranges[i].begin > largest) {
+                    largest = ranges[i].end - ranges[i].begin;
+                    victim = i;
+                }
+            }
+            if (victim < 0) return false;
+
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(ranges[victim].mutex);
+                Range &range = ranges[victim];
+                if (range.begin >= range.end) continue; // someone else was faster
+                end = range.end;
+                begin = range.end - (range.end - range.begin + 1) / 2;
+                range.end = begin;
+            }
+            std::lock_guard<std::mutex> lock(own.mutex);
+            task = begin;
+            own.begin = begin + 1;
+            own.end = end;
+            return true;
+        }
+    }
+
+    const int numThreads;
+    std::vector<Range> ranges;
+
+    /// Guards the batch state below
+    std::mutex mutex;
+    /// Signalled when a batch starts or the pool is destroyed, and when all workers finished a batch
+    std::condition_variable batchReady, batchDone;
+    /// Number of batches started so far
+    uint64_t batch;
+    /// Number of workers still working on the current batch
+    int numBusy;
+    bool stopping;
+    /// The current batch's function
+    TaskFunction batchFunction;
+    const void *batchContext;
+    std::vector<std::thread> workers;
+};
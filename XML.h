@@ -2,12 +2,17 @@
 
 #include <fstream>
 #include <iostream>
+#include <utility>
 #include <vector>
 
 #include "Timer.h"
+#include "BufferedWriter.h"
+#include "Navigation.h"
 #include "OrderedTree.h"
+#include "TopDag.h"
 #include "TopTree.h"
 #include "Labels.h"
+#include "Traversal.h"
 
 #include "3rdparty/pugixml.hpp"
 
@@ -47,18 +52,30 @@ struct XmlParser {
     }
 
 protected:
-    static void parseStructure(TreeType &tree, Labels<string> &labels, pugi::xml_node node, const int id) {
-        const size_t numChildren = std::distance(node.children().begin(), node.children().end());
-        int childId = tree.addNodes(numChildren);
-        for (size_t i = 0; i < numChildren; ++i) {
-            tree.addEdge(id, childId + i);
-        }
+    static void parseStructure(TreeType &tree, Labels<string> &labels, pugi::xml_node root, const int rootId) {
+        // the next child to descend into and its node ID, for each node on the current path
+        std::vector<std::pair<pugi::xml_node, int>> stack;
+        auto addChildren = [&](pugi::xml_node node, const int id) {
+            const size_t numChildren = std::distance(node.children().begin(), node.children().end());
+            const int childId = tree.addNodes(numChildren);
+            for (size_t i = 0; i < numChildren; ++i) {
+                tree.addEdge(id, childId + i);
+            }
+            stack.emplace_back(node.first_child(), childId);
+        };
 
-        // Recurse into children
-        for (pugi::xml_node child : node.children()) {
+        addChildren(root, rootId);
+        while (!stack.empty()) {
+            const pugi::xml_node child = stack.back().first;
+            if (!child) {
+                stack.pop_back();
+                continue;
+            }
+            const int childId = stack.back().second;
+            stack.back().first = child.next_sibling();
+            ++stack.back().second;
             labels.set(childId, child.name());
-            parseStructure(tree, labels, child, childId);
-            ++childId;
+            addChildren(child, childId);
         }
     }
 };
@@ -78,33 +95,29 @@ struct XmlWriter<TopTree<DataType>> {
         std::ofstream out(filename.c_str());
         assert(out.is_open());
 
-        auto writeNode = [&] (const int nodeId, const int depth, const auto &writeNode) {
-            const Cluster<DataType> &node = tree.clusters[nodeId];
-            for (int i = 0; i < depth; ++i) out << " ";
-            out << "<";
-            if (node.label == NULL) out << node.mergeType; else out << *node.label;
-            out << ">";
-
-            if (node.left >= 0 || node.right >= 0) {
-                out << endl;
-
-                if (node.left >= 0) {
-                    writeNode(node.left, depth + 1, writeNode);
-                }
-                if (node.right >= 0) {
-                    writeNode(node.right, depth + 1, writeNode);
-                }
-
-                for (int i = 0; i < depth; ++i) out << " ";
-            }
-
-            out << "</";
+        auto writeLabel = [&](const Cluster<DataType> &node) {
             if (node.label == NULL) out << node.mergeType; else out << *node.label;
-            out << ">";
         };
 
         int rootId = tree.clusters.size() - 1;
-        writeNode(rootId, 0, writeNode);
+        traverseBinary(rootId, tree.childGetter(),
+            [&](const int nodeId, const int depth) {
+                const Cluster<DataType> &node = tree.clusters[nodeId];
+                for (int i = 0; i < depth; ++i) out << " ";
+                out << "<";
+                writeLabel(node);
+                out << ">";
+                if (node.left >= 0 || node.right >= 0) out << endl;
+            },
+            [&](const int nodeId, const int depth) {
+                const Cluster<DataType> &node = tree.clusters[nodeId];
+                if (node.left >= 0 || node.right >= 0) {
+                    for (int i = 0; i < depth; ++i) out << " ";
+                }
+                out << "</";
+                writeLabel(node);
+                out << ">";
+            });
 
         out.close();
     }
@@ -122,28 +135,72 @@ struct XmlWriter<OrderedTree<NodeType, EdgeType>> {
         std::ofstream out(filename.c_str());
         assert(out.is_open());
 
-        auto writeNode = [&] (const int nodeId, const int depth, const auto &writeNode) {
-            if (indent) for (int i = 0; i < depth; ++i) out << " ";
-            out << "<" << labels[nodeId] << ">";
-            if (tree.nodes[nodeId].isLeaf()) {
+        traverseTree(tree, 0,
+            [&](const int nodeId, const int depth) {
+                if (indent) for (int i = 0; i < depth; ++i) out << " ";
+                out << "<" << labels[nodeId] << ">";
+                if (indent && !tree.nodes[nodeId].isLeaf()) out << endl;
+            },
+            [&](const int nodeId, const int depth) {
+                if (indent && !tree.nodes[nodeId].isLeaf()) for (int i = 0; i < depth; ++i) out << " ";
                 out << "</" << labels[nodeId] << ">";
                 if (indent) out << endl;
-                return;
-            }
-            if (indent) out << endl;
+            });
 
-            FORALL_OUTGOING_EDGES(tree, nodeId, edge) {
-                if (edge->valid)
-                    writeNode(edge->headNode, depth + 1, writeNode);
-            }
+        out.close();
+    }
+};
 
-            if (indent) for (int i = 0; i < depth; ++i) out << " ";
-            out << "</" << labels[nodeId] << ">";
-            if (indent) out << endl;
-        };
+/// Top DAG XML writer
+template <typename DataType>
+struct XmlWriter<TopDag<DataType>> {
+    /// Write the tree represented by a Top DAG to an XML file without unpacking it.
+    /// The tree is traversed with a Navigator, so memory usage only depends on
+    /// the DAG and the tree's height, not on the size of the tree. The output is
+    /// the same as writing the unpacked OrderedTree.
+    /// \param dag the Top DAG to write (TopDag, MappedTopDag, or anything else a Navigator can use)
+    /// \param filename filename to use. Directory must exist.
+    /// \param indent whether to indent the tags and put each on its own line
+    /// \return the number of nodes written
+    template <typename DAGType = TopDag<DataType>>
+    static unsigned long long write(const DAGType &dag, const string &filename, const bool indent=true) {
+        std::ofstream out(filename.c_str());
+        assert(out.is_open());
+        BufferedWriter writer(out, 1 << 20);
+        Navigator<DataType, DAGType> nav(dag);
 
-        writeNode(0, 0, writeNode);
+        auto openTag = [&] (const int depth) {
+            if (indent) writer.fill(' ', depth);
+            writer << '<' << *nav.getLabel() << '>';
+            if (indent && !nav.isLeaf()) writer << '\n';
+        };
+        auto closeTag = [&] (const int depth) {
+            if (indent && !nav.isLeaf()) writer.fill(' ', depth);
+            writer << "</" << *nav.getLabel() << '>';
+            if (indent) writer << '\n';
+        };
 
-        out.close();
+        // iterative preorder traversal, closing tags on the way up
+        unsigned long long numNodes = 1;
+        int depth = 0;
+        openTag(depth);
+        while (true) {
+            if (nav.firstChild()) {
+                openTag(++depth);
+                ++numNodes;
+                continue;
+            }
+            closeTag(depth);
+            while (!nav.nextSibling()) {
+                if (!nav.parent()) {
+                    writer.flush();
+                    out.close();
+                    return numNodes;
+                }
+                closeTag(--depth);
+            }
+            openTag(depth);
+            ++numNodes;
+        }
     }
 };
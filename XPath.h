@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+#include "DagSummary.h"
+#include "TopDag.h"
+
+/// A location step of an XPath query
+template <typename DataType>
+struct XPathStep {
+    /// whether the step uses the descendant axis (`//`) instead of the child axis (`/`)
+    bool descendant;
+    /// whether the step matches any label (`*`)
+    bool wildcard;
+    DataType label;
+
+    XPathStep(const bool descendant, const bool wildcard, const DataType &label)
+        : descendant(descendant), wildcard(wildcard), label(label) {}
+
+    bool matches(const DataType &other) const {
+        return wildcard || label == other;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const XPathStep &step) {
+        os << (step.descendant ? "//" : "/");
+        if (step.wildcard) return os << "*";
+        return os << step.label;
+    }
+};
+
+/// Evaluate XPath queries of the form `/a/b//c/*` directly on a Top DAG
+/**
+ * The query is run as an automaton whose state at a tree node consists of two
+ * bit sets over the steps: the steps matched at the node's parent (for the
+ * child axis), and the steps matched at any of its ancestors (for the
+ * descendant axis). Bit 0 is the empty prefix, which is matched at a virtual
+ * node above the root.
+ *
+ * A cluster's result only depends on the state at its top boundary node. It
+ * consists of the number of matches in the cluster and the state handed down
+ * to its bottom boundary node's children. These results are memoised per DAG
+ * node and input state, so repeated subtrees are only evaluated once for each
+ * state they are reached in.
+ *
+ * DAGType can be TopDag or anything else that provides `nodes[i]` and `nodes.size()`.
+ */
+template <typename DataType, typename DAGType = TopDag<DataType>>
+class XPathQuery {
+public:
+    typedef XPathStep<DataType> Step;
+    /// A node's position in the tree as child indices from the root (the root is the empty path)
+    typedef std::vector<long long> Path;
+
+    /// \param dag the Top DAG to query
+    /// \param steps the query's location steps (at most 63)
+    XPathQuery(const DAGType &dag, const std::vector<Step> &steps)
+        : dag(dag), steps(steps), memo(dag.nodes.size()), numMemoEntries(0) {
+        assert(!steps.empty() && steps.size() < 64);
+        finalStep = (uint64_t)1 << steps.size();
+    }
+
+    /// Parse a query like `/a/b//c/*` into its location steps
+    static std::vector<Step> parse(const std::string &query) {
+        std::vector<Step> result;
+        size_t pos = 0;
+        while (pos < query.size()) {
+            if (query[pos] != '/') {
+                std::cout << "Invalid XPath query " << query << ": expected '/' at position " << pos << std::endl;
+                return std::vector<Step>();
+            }
+            const bool descendant = (pos + 1 < query.size() && query[pos + 1] == '/');
+            pos += descendant ? 2 : 1;
+            const size_t end = std::min(query.find('/', pos), query.size());
+            const std::string name = query.substr(pos, end - pos);
+            if (name.empty()) {
+                std::cout << "Invalid XPath query " << query << ": empty step at position " << pos << std::endl;
+                return std::vector<Step>();
+            }
+            result.emplace_back(descendant, name == "*", DataType(name));
+            pos = end;
+        }
+        return result;
+    }
+
+    /// Count the nodes matching the query
+    long long count() {
+        return evaluate(dag.nodes.size() - 1, rootState()).count;
+    }
+
+    /// Call `callback(path)` for every node matching the query. Clusters without
+    /// any matches are skipped. The matches are reported cluster by cluster, so
+    /// sort the paths lexicographically to get them in document order.
+    /// \param summaries the summaries of the DAG, used for the top boundary nodes' fanouts
+    template <typename Callback>
+    void listMatches(const DagSummaries<DataType, DAGType> &summaries, const Callback &callback) {
+        Path path;
+        collect(dag.nodes.size() - 1, rootState(), summaries, path, 0, false, true, callback);
+    }
+
+    /// Number of (DAG node, state) pairs that were evaluated
+    size_t getNumMemoEntries() const {
+        return numMemoEntries;
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const XPathQuery &query) {
+        for (const Step &step : query.steps) {
+            os << step;
+        }
+        return os;
+    }
+
+protected:
+    /// Automaton state at a top boundary node
+    struct State {
+        /// steps matched at the top boundary node
+        uint64_t parent;
+        /// steps matched at the top boundary node or any of its ancestors
+        uint64_t ancestors;
+        bool operator==(const State &other) const {
+            return parent == other.parent && ancestors == other.ancestors;
+        }
+    };
+
+    /// Memoised result of evaluating a cluster in a state
+    struct Result {
+        State input;
+        long long count;
+        /// state at the bottom boundary node, if there is one
+        State output;
+    };
+
+    static State rootState() {
+        return State{1, 1};
+    }
+
+    /// Evaluate the cluster of DAG node `nodeId` with its top boundary node in state `state`
+    Result evaluate(const int nodeId, const State &state) {
+        for (const Result &result : memo[nodeId]) {
+            if (result.input == state) return result;
+        }
+
+        const DagNode<DataType> node = dag.nodes[nodeId];
+        Result result{state, 0, State{0, 0}};
+        if (node.left < 0) {
+            // the cluster is the edge to its bottom boundary node
+            result.output = step(state, *node.label);
+            result.count = (result.output.parent & finalStep) != 0;
+        } else if (node.mergeType == VERT_WITH_BBN || node.mergeType == VERT_NO_BBN) {
+            const Result upper = evaluate(node.left, state);
+            const Result lower = evaluate(node.right, upper.output);
+            result.count = upper.count + lower.count;
+            result.output = lower.output;
+        } else {
+            const Result left = evaluate(node.left, state);
+            const Result right = evaluate(node.right, state);
+            result.count = left.count + right.count;
+            result.output = (node.mergeType == HORZ_LEFT_BBN) ? left.output : right.output;
+        }
+        if (verbose) std::cout << "XP: node " << nodeId << " has " << result.count << " matches" << std::endl;
+
+        memo[nodeId].push_back(result);
+        ++numMemoEntries;
+        return result;
+    }
+
+    /// Compute the state of a node with label `label` whose parent is in state `state`
+    State step(const State &state, const DataType &label) const {
+        uint64_t matched = 0;
+        for (size_t i = 0; i < steps.size(); ++i) {
+            const uint64_t previous = steps[i].descendant ? state.ancestors : state.parent;
+            if (((previous >> i) & 1) && steps[i].matches(label)) {
+                matched |= (uint64_t)2 << i;
+            }
+        }
+        return State{matched, state.ancestors | matched};
+    }
+
+    /// Report the matches in the cluster of DAG node `nodeId` to `callback`
+    /// \param path on entry, the path of the cluster's top boundary node; on exit, that of
+    /// its bottom boundary node if `needBoundary` is set
+    /// \param offset child index of the top boundary node's first child in the cluster
+    /// \param needBoundary whether the bottom boundary node's path is needed
+    /// \param virtualTop whether the top boundary node is the virtual node above the root
+    template <typename Callback>
+    void collect(const int nodeId, const State &state, const DagSummaries<DataType, DAGType> &summaries,
+                 Path &path, const long long offset, const bool needBoundary, const bool virtualTop,
+                 const Callback &callback) {
+        const Result result = evaluate(nodeId, state);
+        if (result.count == 0 && !needBoundary) return;
+
+        const DagNode<DataType> node = dag.nodes[nodeId];
+        if (node.left < 0) {
+            // the root is the only child of the virtual node and has the empty path
+            if (!virtualTop) path.push_back(offset);
+            if (result.count > 0) callback(path);
+            if (!needBoundary && !virtualTop) path.pop_back();
+        } else if (node.mergeType == VERT_WITH_BBN || node.mergeType == VERT_NO_BBN) {
+            const Result upper = evaluate(node.left, state);
+            const Result lower = evaluate(node.right, upper.output);
+            const size_t length = path.size();
+            const bool needLower = lower.count > 0 || (needBoundary && node.mergeType == VERT_WITH_BBN);
+            collect(node.left, state, summaries, path, offset, needLower, virtualTop, callback);
+            if (needLower) {
+                // the bottom boundary node's children are all in the lower part
+                collect(node.right, upper.output, summaries, path, 0, needBoundary, false, callback);
+            }
+            if (!needBoundary) path.resize(length);
+        } else {
+            const size_t length = path.size();
+            const long long rightOffset = offset + summaries[node.left].topFanout;
+            if (needBoundary && node.mergeType == HORZ_LEFT_BBN) {
+                // the right part's paths start from the top boundary node's path, not the left part's bbn
+                Path topPath(path);
+                collect(node.left, state, summaries, path, offset, true, virtualTop, callback);
+                collect(node.right, state, summaries, topPath, rightOffset, false, virtualTop, callback);
+            } else {
+                collect(node.left, state, summaries, path, offset, false, virtualTop, callback);
+                assert(path.size() == length);
+                collect(node.right, state, summaries, path, rightOffset, needBoundary, virtualTop, callback);
+            }
+        }
+    }
+
+    const DAGType &dag;
+    std::vector<Step> steps;
+    /// the bit of the last step
+    uint64_t finalStep;
+    /// memoised results per DAG node (usually just a handful of states each)
+    std::vector<std::vector<Result>> memo;
+    size_t numMemoEntries;
+    static const bool verbose = false;
+};
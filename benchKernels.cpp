@@ -0,0 +1,309 @@
+/*
+ * Microbenchmarks for the core kernels: tree merges, Top DAG insertion and
+ * hashing, the RePair data structures, Huffman code construction, navigation
+ * and XML parsing. Each kernel is run several times on fresh inputs, and the
+ * time per operation is reported with its mean, standard deviation and
+ * minimum over the repetitions, so that regressions show up per kernel.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Data Structures
+#include "Edges.h"
+#include "Labels.h"
+#include "Nodes.h"
+#include "OrderedTree.h"
+#include "TopDag.h"
+
+// Algorithms
+#include "Huffman.h"
+#include "Navigation.h"
+#include "RandomTree.h"
+#include "RePair.h"
+#include "RePair/RePair.h"
+#include "RePairTreeHasher.h"
+#include "TopDagConstructor.h"
+
+// Utils
+#include "ArgParser.h"
+#include "Timer.h"
+#include "XML.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+typedef OrderedTree<TreeNode, TreeEdge> TreeType;
+
+void usage(char* name) {
+    cout << "Usage: " << name << " <options>" << endl
+         << "  -n <int>   input size (default: 1000000)" << endl
+         << "  -i <int>   repetitions (default: 10)" << endl
+         << "  -w <int>   warm-up repetitions, not measured (default: 1)" << endl
+         << "  -l <int>   label alphabet size (default: 2)" << endl
+         << "  -s <int>   seed (default: 12345678)" << endl
+         << "  -f <str>   only run kernels whose name contains this" << endl
+         << "  -x <file>  XML file to parse (default: a random tree written to /tmp)" << endl;
+}
+
+/// One repetition of a kernel
+struct Measurement {
+    /// time spent in the kernel (ms), excluding the setup
+    double time;
+    /// number of operations done
+    long long ops;
+    /// size of the kernel's input (bytes)
+    long long bytes;
+};
+
+/// Run a kernel several times and print its time per operation
+/// \param kernel sets up fresh inputs, times only the kernel itself, and returns a Measurement
+template <typename Kernel>
+void bench(const string &name, const string &filter, const int warmup, const int repetitions, const Kernel &kernel) {
+    if (name.find(filter) == string::npos) return;
+    for (int i = 0; i < warmup; ++i) {
+        kernel();
+    }
+    std::vector<double> nsPerOp;
+    Measurement measurement{0, 0, 0};
+    for (int i = 0; i < repetitions; ++i) {
+        measurement = kernel();
+        nsPerOp.push_back(measurement.time * 1e6 / std::max(1LL, measurement.ops));
+    }
+    double mean(0), variance(0);
+    for (const double ns : nsPerOp) mean += ns;
+    mean /= nsPerOp.size();
+    for (const double ns : nsPerOp) variance += (ns - mean) * (ns - mean);
+    variance /= std::max<size_t>(1, nsPerOp.size() - 1);
+
+    cout << "RESULT type=kernel kernel=" << name << " repetitions=" << repetitions
+         << " ops=" << measurement.ops << " nsPerOp=" << mean << " nsStddev=" << std::sqrt(variance)
+         << " nsMin=" << *std::min_element(nsPerOp.begin(), nsPerOp.end())
+         << " bytesPerOp=" << (measurement.bytes * 1.0) / std::max(1LL, measurement.ops)
+         << " MBps=" << (measurement.bytes / 1e6) / (mean * measurement.ops / 1e9) << endl;
+}
+
+/// Bytes used by a tree's node and edge arrays
+long long treeBytes(const TreeType &tree) {
+    return tree.nodes.size() * sizeof(TreeNode) + tree.edges.size() * sizeof(TreeEdge);
+}
+
+/// Add clusters to a DAG like a construction would, merging neighbouring clusters in rounds
+/// \returns the number of clusters added
+long long mergeClusters(TopDag<int> &dag, const int n) {
+    std::vector<int> clusters(n);
+    for (int i = 0; i < n; ++i) clusters[i] = i;
+    long long ops(0);
+    for (int round = 0; clusters.size() > 1; ++round) {
+        const MergeType type = (round % 2 == 0) ? HORZ_NO_BBN : VERT_WITH_BBN;
+        size_t numLeft(0);
+        for (size_t i = 0; i + 1 < clusters.size(); i += 2, ++ops) {
+            clusters[numLeft++] = dag.addCluster(clusters[i], clusters[i + 1], type);
+        }
+        if (clusters.size() % 2 == 1) clusters[numLeft++] = clusters.back();
+        clusters.resize(numLeft);
+    }
+    return ops;
+}
+
+int main(int argc, char **argv) {
+    ArgParser argParser(argc, argv);
+
+    if (argParser.isSet("h") || argParser.isSet("-help")) {
+        usage(argv[0]);
+        return 0;
+    }
+
+    const int size = argParser.get<int>("n", 1000000);
+    const int repetitions = std::max(1, argParser.get<int>("i", 10));
+    const int warmup = argParser.get<int>("w", 1);
+    const int numLabels = argParser.get<int>("l", 2);
+    const int seed = argParser.get<int>("s", 12345678);
+    const string filter = argParser.get<string>("f", "");
+    string xmlFile = argParser.get<string>("x", "");
+
+    RandomGeneratorType &generator = getRandomGenerator();
+    generator.seed(seed);
+    RandomTreeGenerator<RandomGeneratorType> rand(generator);
+
+    bench("mergeSiblings", filter, warmup, repetitions, [&]() {
+        TreeType tree;
+        rand.generateTree(tree, size);
+        const long long bytes = treeBytes(tree);
+        // merge each node's children in pairs, like one round of horizontal merges
+        Timer timer;
+        long long ops(0);
+        int newNode;
+        MergeType mergeType;
+        for (int nodeId = 0; nodeId < tree._numNodes; ++nodeId) {
+            const TreeNode &node = tree.nodes[nodeId];
+            for (int edge = node.firstEdgeIndex; edge < node.lastEdgeIndex; edge += 2) {
+                const TreeEdge *left = &tree.edges[edge], *right = left + 1;
+                if (tree.nodes[left->headNode].isLeaf() || tree.nodes[right->headNode].isLeaf()) {
+                    tree.mergeSiblings(left, right, newNode, mergeType);
+                    ++ops;
+                }
+            }
+        }
+        return Measurement{timer.get(), ops, bytes};
+    });
+
+    bench("mergeChain", filter, warmup, repetitions, [&]() {
+        TreeType chain;
+        chain.addNodes(size + 1);
+        for (int i = 0; i < size; ++i) {
+            chain.addEdge(i, i + 1);
+        }
+        const long long bytes = treeBytes(chain);
+        // merging a -> b -> c leaves b with c's child, which is merged next
+        Timer timer;
+        long long ops(0);
+        MergeType mergeType;
+        for (int middleId = 1; middleId + 1 < size; middleId += 2, ++ops) {
+            chain.mergeChain(middleId, mergeType);
+        }
+        return Measurement{timer.get(), ops, bytes};
+    });
+
+    bench("addCluster", filter, warmup, repetitions, [&]() {
+        RandomLabels<RandomGeneratorType> labels(size, numLabels, generator);
+        TopDag<int> dag(size, labels);
+        Timer timer;
+        const long long ops = mergeClusters(dag, size);
+        const double time = timer.get();
+        return Measurement{time, ops, (long long)(ops * sizeof(DagNode<int>))};
+    });
+
+    bench("hashCluster", filter, warmup, repetitions, [&]() {
+        TreeType tree;
+        rand.generateTree(tree, size);
+        RandomLabels<RandomGeneratorType> labels(tree._numNodes, numLabels, generator);
+        TopDag<int> dag(tree._numNodes, labels);
+        mergeClusters(dag, tree._numNodes);
+        std::vector<int> nodeIds;
+        NodeHasher<TreeType, int> hasher(tree, dag, nodeIds);
+        // clusters are numbered bottom-up, so their children are always hashed first
+        Timer timer;
+        uint hash(0);
+        for (int clusterId = 0; clusterId <= dag.maxClusterId; ++clusterId) {
+            hash ^= hasher.hashCluster(clusterId);
+        }
+        const double time = timer.get();
+        if (hash == 0) cout << "(hash is zero)" << endl; // keep the hashes from being optimised away
+        return Measurement{time, dag.maxClusterId + 1LL, (dag.maxClusterId + 1LL) * (long long)sizeof(DagNode<int>)};
+    });
+
+    bench("priorityQueue", filter, warmup, repetitions, [&]() {
+        // few frequent and many rare pairs, like in a tree's RePair round
+        std::vector<SimpleRePair::Record<int>> records;
+        records.reserve(size);
+        std::uniform_real_distribution<double> distribution(0.0, 1.0);
+        for (int i = 0; i < size; ++i) {
+            records.emplace_back(i);
+            records.back().frequency = 2 + (uint)(1.0 / (distribution(generator) + 1e-6));
+        }
+        SimpleRePair::PriorityQueue<int> queue;
+        queue.init((int)std::sqrt(size));
+        Timer timer;
+        long long ops(0);
+        for (auto &record : records) {
+            queue.insert(&record);
+        }
+        ops += records.size();
+        // decrement every other record once, like overlapping occurrences do
+        for (size_t i = 0; i < records.size(); i += 2, ++ops) {
+            queue.decrementFrequency(&records[i]);
+        }
+        while (!queue.empty()) {
+            queue.popMostFrequentRecord();
+            ++ops;
+        }
+        return Measurement{timer.get(), ops, (long long)(records.size() * sizeof(SimpleRePair::Record<int>))};
+    });
+
+    bench("recordsInit", filter, warmup, repetitions, [&]() {
+        std::vector<int> text(size);
+        std::uniform_int_distribution<int> distribution(0, std::max(1, numLabels) * 16 - 1);
+        for (int &symbol : text) symbol = distribution(generator);
+        RePair::Records<int> records;
+        Timer timer;
+        records.init(text);
+        return Measurement{timer.get(), (long long)text.size(), (long long)(text.size() * sizeof(int))};
+    });
+
+    bench("huffmanConstruct", filter, warmup, repetitions, [&]() {
+        // skewed symbol frequencies over a large alphabet
+        HuffmanBuilder<int> builder;
+        std::uniform_real_distribution<double> distribution(0.0, 1.0);
+        for (int i = 0; i < size; ++i) {
+            const double x = distribution(generator);
+            builder.addItem((int)(size * x * x * x));
+        }
+        Timer timer;
+        builder.construct();
+        const double time = timer.get();
+        return Measurement{time, builder.getNumSymbols(), (long long)size * (long long)sizeof(int)};
+    });
+
+    bench("navigatorMoves", filter, warmup, repetitions, [&]() {
+        TreeType tree;
+        rand.generateTree(tree, size);
+        RandomLabels<RandomGeneratorType> labels(tree._numNodes, numLabels, generator);
+        TopDag<int> dag(tree._numNodes, labels);
+        TopDagConstructor<TreeType, int> constructor(tree, dag, false);
+        constructor.construct();
+        Navigator<int> nav(dag);
+        // preorder traversal using firstChild, nextSibling and parent
+        Timer timer;
+        long long ops(0);
+        bool done(false);
+        while (!done) {
+            if (nav.firstChild()) {
+                ++ops;
+                continue;
+            }
+            while (!nav.nextSibling()) {
+                if (!nav.parent()) {
+                    done = true;
+                    break;
+                }
+                ++ops;
+            }
+            ++ops;
+        }
+        const double time = timer.get();
+        return Measurement{time, ops, (long long)(dag.nodes.size() * sizeof(DagNode<int>))};
+    });
+
+    if (xmlFile == "" && string("xmlParse").find(filter) != string::npos) {
+        TreeType tree;
+        rand.generateTree(tree, size);
+        // numbers aren't valid tag names
+        std::uniform_int_distribution<int> distribution(0, numLabels - 1);
+        Labels<string> labels(tree._numNodes);
+        for (int nodeId = 0; nodeId < tree._numNodes; ++nodeId) {
+            labels.set(nodeId, "l" + std::to_string(distribution(generator)));
+        }
+        xmlFile = "/tmp/benchKernels.xml";
+        XmlWriter<TreeType>::write(tree, labels, xmlFile, false);
+    }
+    std::ifstream xml(xmlFile, std::ios::binary | std::ios::ate);
+    const long long xmlBytes = xml.is_open() ? (long long)xml.tellg() : 0;
+    bench("xmlParse", filter, warmup, repetitions, [&]() {
+        TreeType tree;
+        Labels<string> labels;
+        Timer timer;
+        if (!XmlParser<TreeType>::parse(xmlFile, tree, labels, false)) {
+            cout << "Could not parse " << xmlFile << endl;
+        }
+        const double time = timer.get();
+        return Measurement{time, tree._numNodes, xmlBytes};
+    });
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Compare recursive tree traversals (with std::function and with generic
+ * lambdas) to the iterative ones from Traversal.h, and traverse a chain that is
+ * too deep for recursion.
+ */
+
+#include <functional>
+#include <iostream>
+
+// Data Structures
+#include "Edges.h"
+#include "Nodes.h"
+#include "OrderedTree.h"
+
+// Algorithms
+#include "RandomTree.h"
+#include "Traversal.h"
+
+// Utils
+#include "ArgParser.h"
+#include "Timer.h"
+
+using std::cout;
+using std::endl;
+
+typedef OrderedTree<TreeNode, TreeEdge> TreeType;
+
+void usage(char* name) {
+    cout << "Usage: " << name << " <options>" << endl
+         << "  -n <int>   random tree size (edges) (default: 1000000)" << endl
+         << "  -c <int>   chain length (default: 10000000)" << endl
+         << "  -i <int>   iterations (default: 10)" << endl
+         << "  -s <int>   seed (default: 12345678)" << endl;
+}
+
+/// Sum of all nodes' depths, recursing with a std::function
+long long depthSumFunction(const TreeType &tree) {
+    long long sum(0);
+    const std::function<void (const int, const int)> visit([&](const int nodeId, const int depth) {
+        sum += depth;
+        FORALL_OUTGOING_EDGES(tree, nodeId, edge) {
+            if (edge->valid) visit(edge->headNode, depth + 1);
+        }
+    });
+    visit(0, 0);
+    return sum;
+}
+
+/// Sum of all nodes' depths, recursing with a generic lambda
+long long depthSumLambda(const TreeType &tree) {
+    long long sum(0);
+    auto visit = [&](const int nodeId, const int depth, const auto &visit) -> void {
+        sum += depth;
+        FORALL_OUTGOING_EDGES(tree, nodeId, edge) {
+            if (edge->valid) visit(edge->headNode, depth + 1, visit);
+        }
+    };
+    visit(0, 0, visit);
+    return sum;
+}
+
+/// Sum of all nodes' depths, using an explicit stack
+long long depthSumIterative(const TreeType &tree) {
+    long long sum(0);
+    traverseTree(tree, 0, [&](const int, const int depth) { sum += depth; }, [](const int, const int) {});
+    return sum;
+}
+
+template <typename Traversal>
+void bench(const std::string &name, const TreeType &tree, const int iterations, const Traversal &traversal) {
+    Timer timer;
+    long long result(0);
+    for (int i = 0; i < iterations; ++i) {
+        result += traversal(tree);
+    }
+    cout << "RESULT type=traversal method=" << name << " nodes=" << tree._numNodes
+         << " iterations=" << iterations << " time=" << timer.get() / iterations
+         << " check=" << result / iterations << endl;
+}
+
+int main(int argc, char **argv) {
+    ArgParser argParser(argc, argv);
+
+    if (argParser.isSet("h") || argParser.isSet("-help")) {
+        usage(argv[0]);
+        return 0;
+    }
+
+    const int size = argParser.get<int>("n", 1000000);
+    const int chainLength = argParser.get<int>("c", 10000000);
+    const int iterations = argParser.get<int>("i", 10);
+    const int seed = argParser.get<int>("s", 12345678);
+
+    getRandomGenerator().seed(seed);
+    RandomTreeGenerator<RandomGeneratorType> rand(getRandomGenerator());
+    TreeType tree;
+    rand.generateTree(tree, size);
+    cout << "Random tree: " << tree.summary() << endl;
+
+    bench("function", tree, iterations, depthSumFunction);
+    bench("lambda", tree, iterations, depthSumLambda);
+    bench("iterative", tree, iterations, depthSumIterative);
+
+    // A chain this long overflows the call stack when traversed recursively
+    TreeType chain;
+    chain.addNodes(chainLength + 1);
+    for (int i = 0; i < chainLength; ++i) {
+        chain.addEdge(i, i + 1);
+    }
+    Timer timer;
+    const int height = chain.height();
+    cout << "RESULT type=chain nodes=" << chain._numNodes << " height=" << height
+         << " time=" << timer.get() << endl;
+
+    return 0;
+}
@@ -9,6 +9,8 @@
 #include <iostream>
 #include <string>
 
+#include "AllocationHook.h"
+
 // Data Structures
 #include "Edges.h"
 #include "Nodes.h"
@@ -26,7 +28,9 @@
 // Utils
 #include "ArgParser.h"
 #include "FileWriter.h"
-#include "Timer.h"
+#include "MemoryUsage.h"
+#include "PhaseTimer.h"
+#include "BPFile.h"
 #include "XML.h"
 
 
@@ -36,9 +40,11 @@ using std::string;
 
 void usage(char* name) {
     cout << "Usage: " << name << " <options> [filename]" << endl
+         << "  filename    XML or BP file (see strip -b)" << endl
          << "  -r          enable RePair combiner" << endl
          << "  -m <float>  minimum merge ratio for RePair combiner, below" << endl
-         << "              which fallback is invoked (default: 1.26)" << endl;
+         << "              which fallback is invoked (default: 1.26)" << endl
+         << "  -a          measure peak memory and allocations per phase" << endl;
 }
 
 int main(int argc, char **argv) {
@@ -52,22 +58,30 @@ int main(int argc, char **argv) {
     string filename = "data/1998statistics.xml";
     if (argParser.numDataArgs() > 0) {
         filename = argParser.getDataArg(0);
-    } else if (useRePair) {
+    } else {
         // if used as "./coding -r foo.xml", it will match the foo.xml to the "-r" which is unfortunate
-        string arg = argParser.get<string>("r", "");
-        filename = (arg == "") ? filename : arg;
+        for (const char *flag : {"r", "a"}) {
+            const string arg = argParser.get<string>(flag, "");
+            filename = (arg == "") ? filename : arg;
+        }
     }
     const double minRatio = argParser.get<double>("m", 1.26);
+    MemoryUsage::setEnabled(argParser.isSet("a"));
 
     OrderedTree<TreeNode, TreeEdge> t;
     Labels<string> labels;
 
-    const bool result = XmlParser<OrderedTree<TreeNode, TreeEdge>>::parse(filename, t, labels);
+    MemoryValues parseMemory, mergeMemory, dagMemory, entropyMemory;
+    PhaseMemory memory;
+    ScopedPhase parsing("parse");
+    const bool result = readTreeFile(filename, t, labels);
+    parsing.stop();
     if (!result) {
         std::cout << "Could not parse input file, aborting" << std::endl;
         exit(1);
     }
 
+    memory.next(&parseMemory);
     const int origNodes(t._numNodes), origEdges(t._numEdges), origHeight(t.height());
     const double origAvgDepth(t.avgDepth());
     cout << t.summary() << "; Height: " << origHeight << " Avg depth: " << origAvgDepth << endl;
@@ -75,7 +89,8 @@ int main(int argc, char **argv) {
     TopDag<string> dag(t._numNodes, labels);
     const long long treeSize = TreeSizeEstimation<OrderedTree<TreeNode, TreeEdge>>::compute(t, labels);
 
-    Timer timer;
+    memory.next(NULL);
+    ScopedPhase construction("construct");
     if (useRePair) {
         RePairCombiner<OrderedTree<TreeNode, TreeEdge>, string> topDagConstructor(t, dag);
         topDagConstructor.construct(NULL, minRatio);
@@ -83,7 +98,8 @@ int main(int argc, char **argv) {
         TopDagConstructor<OrderedTree<TreeNode, TreeEdge>, string> topDagConstructor(t, dag);
         topDagConstructor.construct();
     }
-    cout << "Top DAG construction took " << timer.getAndReset() << "ms" << endl;
+    cout << "Top DAG construction took " << construction.stop() << "ms" << endl;
+    memory.next(&mergeMemory);
 /*
     const double ttAvgDepth(topTree.avgDepth());
     const int ttMinDepth(topTree.minDepth()), ttHeight(topTree.height());
@@ -91,23 +107,47 @@ int main(int argc, char **argv) {
          << "took " << timer.getAndReset() << "ms" << endl;
 */
 
+    ScopedPhase dagStatistics("dag");
     const int edges(dag.countEdges()), nodes((int)dag.nodes.size() - 1);
+    dagStatistics.stop();
     const double edgePercentage = (edges * 100.0) / origEdges;
     const double nodePercentage = (nodes * 100.0) / origNodes;
     const double ratio = ((int)(1000 / edgePercentage)) / 10.0;
     cout << "Top dag has " << nodes << " nodes (" << nodePercentage << "%), "
          << edges << " edges (" << edgePercentage << "% of original tree, " << ratio << ":1)" << endl;
 
-    long long bits = FileWriter::write(dag, labels, "/tmp/foo");
+    memory.next(&dagMemory);
+
+    long long ansBits(0), deltaBits(0);
+    ScopedPhase entropyCoding("entropy");
+    long long bits = FileWriter::write(dag, labels, "/tmp/foo", true, &ansBits, &deltaBits);
+    entropyCoding.stop();
+    memory.next(&entropyMemory);
 
     const std::streamsize precision = cout.precision();
     cout << "Output file needs " << bits << " bits (" << (bits+7)/8 << " bytes), vs " << (treeSize+7)/8 << " bytes for orig succ tree, "
          << std::fixed << std::setprecision(1) << (double)treeSize/bits << ":1" << endl;
+    cout << "With rANS instead of Huffman for the DAG: " << ansBits << " bits (" << (ansBits+7)/8 << " bytes), "
+         << (double)treeSize/ansBits << ":1" << endl;
+    cout << "With the best delta coding for DAG pointers: " << deltaBits << " bits (" << (deltaBits+7)/8 << " bytes), "
+         << (double)treeSize/deltaBits << ":1" << endl;
+    if (MemoryUsage::isEnabled()) {
+        cout << "Peak memory (bytes/node, allocations):";
+        const std::pair<const char *, const MemoryValues *> phases[] = {
+            {"parse", &parseMemory}, {"construct", &mergeMemory}, {"DAG", &dagMemory}, {"entropy", &entropyMemory}};
+        for (const auto &phase : phases) {
+            cout << " " << phase.first << " " << phase.second->peakBytes / 1048576.0 << " MiB ("
+                 << (phase.second->peakBytes * 1.0) / origNodes << ", " << phase.second->allocations << ")";
+        }
+        cout << "; RSS " << MemoryUsage::residentBytes() / 1048576.0 << " MiB" << endl;
+    }
     cout.unsetf(std::ios_base::fixed);
     cout << std::setprecision(precision);
 
     cout << "RESULT"
          << " compressed=" << bits
+         << " compressedAns=" << ansBits
+         << " compressedDelta=" << deltaBits
          << " succinct=" << treeSize
          << " minRatio=" << minRatio
          << " repair=" << useRePair
@@ -121,7 +161,18 @@ int main(int argc, char **argv) {
          //<< " ttAvgDepth=" << ttAvgDepth
          //<< " ttMinDepth=" << ttMinDepth
          //<< " ttHeight=" << ttHeight
-         << endl;
+         ;
+    if (MemoryUsage::isEnabled()) {
+        cout << " parsePeak=" << parseMemory.peakBytes
+             << " constructPeak=" << mergeMemory.peakBytes
+             << " dagPeak=" << dagMemory.peakBytes
+             << " entropyPeak=" << entropyMemory.peakBytes
+             << " parseAllocs=" << parseMemory.allocations
+             << " constructAllocs=" << mergeMemory.allocations
+             << " dagAllocs=" << dagMemory.allocations
+             << " entropyAllocs=" << entropyMemory.allocations;
+    }
+    cout << endl;
 
     return 0;
 }
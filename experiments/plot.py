@@ -3,9 +3,14 @@
 
 # generate input file from statistics dumps with:
 # for f in res_*; do echo -n "$f\t" | sed 's,.*res_,,'; cat $f | grep "Edges" | cut -d ' ' -f 3; done > eval
+#
+# plot a merge profile written by `test -p profile.csv` (or .json) with:
+# plot.py --profile profile.csv
 
 from pylab import *
 from math import log
+import csv
+import json
 
 sigma = 2  # alphabet size
 
@@ -28,10 +33,52 @@ def plotstats(inputfile):
     ax.set_ylabel('compression ratio / log_4σ(n)')
     show()
 
+def readprofile(inputfile):
+    with open(inputfile, 'r') as infile:
+        if inputfile.endswith('.json'):
+            return json.load(infile)['iterations']
+        return [{key: float(value) for (key, value) in row.items()} for row in csv.DictReader(infile)]
+
+def plotprofile(inputfile):
+    rows = readprofile(inputfile)
+    it = [row['iteration'] for row in rows]
+    column = lambda key: [row[key] for row in rows]
+
+    fig, ((merges, times), (memory, rates)) = subplots(2, 2, sharex=True)
+    merges.plot(it, column('horizontalMerges'), 'o-', label='horizontal merges')
+    merges.plot(it, column('verticalMerges'), 's-', label='vertical merges')
+    merges.plot(it, column('numNodes'), 'v-', label='live nodes')
+    merges.plot(it, column('numEdges'), '^-', label='live edges')
+    merges.plot(it, column('dagNodesAdded'), 'x-', label='DAG nodes added')
+    merges.set_yscale('log')
+    merges.legend()
+
+    times.stackplot(it, column('horizontalTime'), column('compactTime'), column('verticalTime'),
+                    labels=['horizontal', 'compact', 'vertical'])
+    times.set_ylabel('time (ms)')
+    times.legend()
+
+    memory.plot(it, [b / 2**20 for b in column('treeBytes')], 'o-', label='tree')
+    memory.plot(it, [b / 2**20 for b in column('dagBytes')], 's-', label='DAG')
+    memory.set_ylabel('memory (MiB)')
+    memory.set_xlabel('iteration')
+    memory.legend()
+
+    rates.plot(it, column('edgeFill'), 'o-', label='edge fill')
+    rates.plot(it, column('hashHitRate'), 's-', label='hash hit rate')
+    rates.set_ylim(0, 1.05)
+    rates.set_xlabel('iteration')
+    rates.legend()
+    show()
+
 
 if __name__ == '__main__':
     import sys
-    if len(sys.argv) < 2:
+    if len(sys.argv) == 3 and sys.argv[1] == '--profile':
+        plotprofile(sys.argv[2])
+    elif len(sys.argv) == 2:
+        plotstats(sys.argv[1])
+    else:
         print('Usage: {0} inputfile'.format(sys.argv[0]))
+        print('       {0} --profile profile.csv|profile.json'.format(sys.argv[0]))
         sys.exit(1)
-    plotstats(sys.argv[1])
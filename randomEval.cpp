@@ -10,9 +10,11 @@
 #include <iostream>
 #include <string>
 
-#include <thread>
+#include <atomic>
 #include <mutex>
+#include <thread>
 
+#include "AllocationHook.h"
 #include "Common.h"
 
 // Data Structures
@@ -25,6 +27,7 @@
 
 // Algorithms
 #include "RandomTree.h"
+#include "SyntheticTree.h"
 #include "TopDagUnpacker.h"
 #include "RePairCombiner.h"
 #include "TopDagConstructor.h"
@@ -33,7 +36,9 @@
 #include "ArgParser.h"
 #include "ProgressBar.h"
 #include "Statistics.h"
+#include "PhaseTimer.h"
 #include "Timer.h"
+#include "WorkStealingPool.h"
 #include "XML.h"
 
 using std::cout;
@@ -45,19 +50,24 @@ void usage(char* name) {
          << "  -n <int>  number of trees to test (default: 100)" << endl
          << "  -l <int>  number of different labels to assign to the nodes (default: 2)" << endl
          << "  -s <int>  seed (default: 12345678)" << endl
+         << "  -d <str>  tree shape: uniform, dblp, treebank, chains, or repetitive (default: uniform)" << endl
          << "  -r        use RePair-inspired combiner" << endl
          << "  -g <file> set output file for edge compression ratios (default: no output)" << endl
          << "  -o <file> set output file for debug information (default: no output)" << endl
          << "  -w <path> set output folder for generated trees as XML files (default: don't write)" << endl
          << "  -t <int>  number of threads to use (default: #cores)" << endl
+         << "  -p        measure hardware counters per phase (Linux perf_event)" << endl
+         << "  -a        measure peak memory and allocations per phase" << endl
          << "  -v        verbose" << endl
          << "  -vv       extra verbose" << endl;
 }
 
-std::mutex debugMutex;
+/// the number of finished trees, and a lock for the progress bar
+std::atomic<int> numFinished(0);
+std::mutex barMutex;
 
 void runIteration(const int iteration, RandomGeneratorType &generator, const uint seed, const int size,
-        const int numLabels, const bool useRepair, const bool verbose, const bool extraVerbose,
+        const int numLabels, const SyntheticTreeParameters *workload, const bool useRepair, const bool verbose, const bool extraVerbose,
         Statistics &statistics, ProgressBar &bar, const string &treePath) {
     // Seed RNG
     generator.seed(seed);
@@ -68,12 +78,21 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
     RandomTreeGenerator<RandomGeneratorType> rand(generator);
 
     Timer timer;
+    PhaseMemory memory;
 
     // Generate random tree
-    rand.generateTree(tree, size);
-    RandomLabels<RandomGeneratorType> labels(size + 1, numLabels, generator);
+    ScopedPhase generation("generate");
+    if (workload == nullptr) rand.generateTree(tree, size);
+    RandomLabels<RandomGeneratorType> labels(workload == nullptr ? size + 1 : 0, numLabels, generator);
+    if (workload != nullptr) {
+        SyntheticTreeGenerator<RandomGeneratorType> synthetic(generator, *workload);
+        synthetic.generateTree(tree, labels.labels, size);
+    }
 
     debugInfo.generationDuration = timer.get();
+    generation.stop();
+    memory.next(&debugInfo.generationMemory);
+    debugInfo.numNodes = tree._numNodes;
     if (verbose) cout << "Generated " << tree.summary() << " in " << timer.get() << "ms" << endl;
     timer.reset();
 
@@ -87,7 +106,10 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
         debugInfo.ioDuration = timer.getAndReset();
     }
 
+    // don't attribute statistics and I/O to the construction
+    memory.next(NULL);
     const int treeEdges = tree._numEdges;
+    ScopedPhase construction("construct");
     TopDag<int> dag(tree._numNodes, labels);
     if (useRepair) {
         RePairCombiner<OrderedTree<TreeNode, TreeEdge>, int> topDagConstructor(tree, dag, verbose, extraVerbose);
@@ -96,6 +118,8 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
         TopDagConstructor<OrderedTree<TreeNode, TreeEdge>, int> topDagConstructor(tree, dag, verbose, extraVerbose);
         topDagConstructor.construct(&debugInfo);
     }
+    memory.next(&debugInfo.mergeMemory);
+    construction.stop();
 
     tree.clear();  // free memory
 
@@ -114,10 +138,13 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
     debugInfo.statDuration += timer.getAndReset();
 */
 
+    ScopedPhase dagStatistics("dag");
     const int edges = dag.countEdges();
     const double percentage = (edges * 100.0) / treeEdges;
     const double ratio = ((int)(1000 / percentage)) / 10.0;
     debugInfo.dagDuration = timer.get();
+    memory.next(&debugInfo.dagMemory);
+    dagStatistics.stop();
     if (verbose)
         cout << "Top dag has " << dag.nodes.size() - 1 << " nodes, " << edges << " edges (" << percentage
              << "% of original tree, " << ratio << ":1)" << endl;
@@ -125,10 +152,13 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
     debugInfo.numDagEdges = edges;
     debugInfo.numDagNodes = dag.nodes.size() - 1;
 
-    debugMutex.lock();
     statistics.addDebugInfo(debugInfo);
-    ++bar;
-    debugMutex.unlock();
+    ++numFinished;
+    // the bar is drawn by any thread that doesn't have to wait for it
+    if (barMutex.try_lock()) {
+        bar.stepto(numFinished);
+        barMutex.unlock();
+    }
 }
 
 int main(int argc, char **argv) {
@@ -143,6 +173,7 @@ int main(int argc, char **argv) {
     const int numIterations = argParser.get<int>("n", 100);
     const uint numLabels = argParser.get<uint>("l", 2);
     const uint seed = argParser.get<uint>("s", 12345678);
+    const string workloadName = argParser.get<string>("d", "uniform");
     const bool verbose = argParser.isSet("v") || argParser.isSet("vv");
     const bool extraVerbose = argParser.isSet("vv");
     const bool useRepair = argParser.isSet("r");
@@ -154,6 +185,17 @@ int main(int argc, char **argv) {
         makePathRecursive(treePath);
     }
 
+    SyntheticTreeParameters workload;
+    if (workloadName != "uniform" && !workload.setWorkload(workloadName, numLabels)) {
+        cout << "Unknown tree shape: " << workloadName << endl;
+        usage(argv[0]);
+        return 1;
+    }
+    const SyntheticTreeParameters *workloadPtr = (workloadName == "uniform") ? nullptr : &workload;
+
+    HardwareCounters::setEnabled(argParser.isSet("p"));
+    MemoryUsage::setEnabled(argParser.isSet("a"));
+
     int numWorkers(std::thread::hardware_concurrency());
     numWorkers = argParser.get<int>("t", numWorkers);
 
@@ -161,7 +203,7 @@ int main(int argc, char **argv) {
     ProgressBar bar(numIterations, std::cerr);
 
     cout << "Running experiments with " << numIterations << " trees of size " << size << " with " << numLabels
-         << " different labels" << flush;
+         << " different labels (" << workloadName << " shape)" << flush;
 
     // Generate seeds deterministically from the input parameters
     vector<uint> seeds(numIterations);
@@ -173,33 +215,18 @@ int main(int argc, char **argv) {
         seeds[0] = seed;
     }
 
-    // function that the threads will execute
-    auto worker = [&](int start, int end) {
-        RandomGeneratorType engine{};
-        for (int i = start; i < end; ++i) {
-            runIteration(i, engine, seeds[i], size, numLabels, useRepair, verbose, extraVerbose, statistics, bar, treePath);
-        }
-    };
-
-    const int treesPerThread = numIterations / numWorkers;
-    const int leftovers = numIterations % numWorkers;
-
-    vector<std::thread> workers;
-
-    cout << " using " << numWorkers << " threads" << endl;
-
-    int min(0), max(treesPerThread);
-    for (int i = 0; i < numWorkers; ++i) {
-        if (i < leftovers) {
-            max++;
-        }
-        workers.push_back(std::thread(worker, min, max));
-        min = max;
-        max += treesPerThread;
-    }
-
-    for (std::thread &worker : workers) {
-        worker.join();
+    WorkStealingPool pool(numWorkers);
+    cout << " using " << pool.getNumThreads() << " threads" << endl;
+
+    // every thread has its own random generator and statistics, which are merged at the end
+    vector<RandomGeneratorType> engines(pool.getNumThreads());
+    vector<Statistics> threadStatistics(pool.getNumThreads());
+    pool.run(numIterations, [&](const size_t i, const int threadId) {
+        runIteration(i, engines[threadId], seeds[i], size, numLabels, workloadPtr, useRepair, verbose, extraVerbose,
+                     threadStatistics[threadId], bar, treePath);
+    });
+    for (const Statistics &threadStats : threadStatistics) {
+        statistics.merge(threadStats);
     }
 
     bar.undraw();
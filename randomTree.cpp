@@ -5,6 +5,7 @@
  */
 
 #include <iostream>
+#include <thread>
 
 // Data Structures
 #include "Edges.h"
@@ -17,6 +18,7 @@
 // Algorithms
 #include "TopDagUnpacker.h"
 #include "DotGraphExporter.h"
+#include "ParallelRandomTree.h"
 #include "RandomTree.h"
 #include "TopDagConstructor.h"
 
@@ -34,6 +36,7 @@ void usage(char* name) {
          << "  -l <int>   number of distinct labels" << endl
          << "  -o <str>   output XML filename (default: do not write)" << endl
          << "  -s <int>   seed (default: 12345678)" << endl
+         << "  -t <int>   number of threads to generate the tree with (default: #cores)" << endl
          << "  -d         dump DOT graph if tree is small enough" << endl
          << "  -c         construct Top DAG" << endl
          << "  -v         verbose output" << endl;
@@ -54,10 +57,12 @@ int main(int argc, char **argv) {
     const bool dump = argParser.isSet("d");
     const bool construct = argParser.isSet("c");
     const bool verbose = argParser.isSet("v");
+    const int numThreads = argParser.get<int>("t", std::thread::hardware_concurrency());
 
     // Initiliase
     getRandomGenerator().seed(seed);
-    RandomTreeGenerator<RandomGeneratorType> rand(getRandomGenerator());
+    WorkStealingPool pool(numThreads);
+    ParallelRandomTreeGenerator<RandomGeneratorType> rand(getRandomGenerator(), pool);
     OrderedTree<TreeNode, TreeEdge> tree;
 
     // Generate the tree and the labels
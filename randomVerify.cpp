@@ -10,9 +10,12 @@
 #include <iostream>
 #include <string>
 
-#include <thread>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <thread>
 
+#include "AllocationHook.h"
 #include "Common.h"
 
 // Data Structures
@@ -25,16 +28,22 @@
 
 // Algorithms
 #include "RandomTree.h"
+#include "SyntheticTree.h"
 #include "TopDagUnpacker.h"
+#include "TopDagTreeUnpacker.h"
+#include "ParallelTreeUnpacker.h"
 #include "RePairCombiner.h"
 #include "TopDagConstructor.h"
 #include "TopTreeUnpacker.h"
+#include "XPath.h"
 
 // Utils
 #include "ArgParser.h"
 #include "ProgressBar.h"
 #include "Statistics.h"
+#include "PhaseTimer.h"
 #include "Timer.h"
+#include "WorkStealingPool.h"
 #include "XML.h"
 
 using std::cout;
@@ -46,19 +55,102 @@ void usage(char* name) {
          << "  -n <int>  number of trees to test (default: 100)" << endl
          << "  -l <int>  number of different labels to assign to the nodes (default: 2)" << endl
          << "  -s <int>  seed (default: 12345678)" << endl
+         << "  -d <str>  tree shape: uniform, dblp, treebank, chains, or repetitive (default: uniform)" << endl
          << "  -r <file> set output file for edge compression ratios (default: no output)" << endl
          << "  -o <file> set output file for debug information (default: no output)" << endl
          << "  -w <path> set output folder for generated trees as XML files (default: don't write)" << endl
          << "  -t <int>  number of threads to use (default: #cores)" << endl
+         << "  -p        measure hardware counters per phase (Linux perf_event)" << endl
+         << "  -a        measure peak memory and allocations per phase" << endl
          << "  -v        verbose" << endl
          << "  -vv       extra verbose" << endl;
 }
 
-std::mutex debugMutex;
+/// Compare random XPath queries on the DAG with a plain walk of the tree
+/**
+ * Every query's count() and listMatches() must give the nodes that match by
+ * definition: a node matches step `i` if its label matches and its parent
+ * (child axis) or any of its ancestors (descendant axis) matches step `i - 1`,
+ * where only the virtual node above the root matches the empty prefix.
+ * The matches' paths are only stored and compared while their total length
+ * stays below a few steps per node, as they would take quadratic space in
+ * deep trees. Beyond that, only the numbers of matches and their total path
+ * lengths are compared.
+ */
+void verifyXPath(const TopDag<int> &dag, const OrderedTree<TreeNode, TreeEdge> &tree,
+                 const RandomLabels<RandomGeneratorType> &labels, RandomGeneratorType &generator, const uint seed) {
+    typedef XPathQuery<int>::Path Path;
+    const int numQueries = 3;
+    const size_t maxPathSteps = 16 * (size_t)tree._numNodes;
+    DagSummaries<int> summaries(dag);
+    for (int q = 0; q < numQueries; ++q) {
+        // one to three steps, labelled like random nodes so that they match something
+        vector<XPathStep<int>> steps;
+        const int numSteps = 1 + generator() % 3;
+        for (int i = 0; i < numSteps; ++i) {
+            steps.emplace_back(generator() % 2 == 0, generator() % 4 == 0, labels[generator() % tree._numNodes]);
+        }
+        XPathQuery<int> query(dag, steps);
+        const long long count = query.count();
+        vector<Path> listed;
+        size_t numListed = 0, listedSteps = 0;
+        query.listMatches(summaries, [&](const Path &path) {
+            ++numListed;
+            listedSteps += path.size();
+            if (listedSteps <= maxPathSteps) listed.push_back(path);
+        });
+        std::sort(listed.begin(), listed.end());
+
+        // walk the tree in preorder (= document order), keeping the steps matched at the
+        // nodes on the current path (after the virtual node's), the steps matched at any
+        // of them up to each depth, and their child indices
+        vector<Path> expected;
+        size_t numExpected = 0, expectedSteps = 0;
+        vector<uint64_t> matched(1, 1), ancestorsMatched(1, 1);
+        Path path;
+        vector<long long> numChildrenSeen;
+        traverseTree(tree, 0,
+            [&](const int nodeId, const int depth) {
+                if (depth > 0) {
+                    path.resize(depth - 1);
+                    path.push_back(numChildrenSeen[depth - 1]++);
+                }
+                numChildrenSeen.resize(depth);
+                numChildrenSeen.push_back(0);
+                matched.resize(depth + 1);
+                ancestorsMatched.resize(depth + 1);
+                uint64_t nodeMatched = 0;
+                for (size_t i = 0; i < steps.size(); ++i) {
+                    if (!steps[i].matches(labels[nodeId])) continue;
+                    const uint64_t previous = steps[i].descendant ? ancestorsMatched[depth] : matched[depth];
+                    if ((previous >> i) & 1) nodeMatched |= (uint64_t)2 << i;
+                }
+                matched.push_back(nodeMatched);
+                ancestorsMatched.push_back(ancestorsMatched[depth] | nodeMatched);
+                if ((nodeMatched >> steps.size()) & 1) {
+                    ++numExpected;
+                    expectedSteps += path.size();
+                    if (expectedSteps <= maxPathSteps) expected.push_back(path);
+                }
+            },
+            [](const int, const int) {});
+
+        if (count != (long long)numExpected || numListed != numExpected || listedSteps != expectedSteps ||
+            (expectedSteps <= maxPathSteps && listed != expected)) {
+            std::cerr << "XPath query " << query << " produced incorrect result for seed " << seed
+                      << ": RESULTS DIFFER (counted " << count << ", listed " << numListed << ", expected "
+                      << numExpected << " matches)" << endl;
+        }
+    }
+}
+
+/// the number of finished trees, and a lock for the progress bar
+std::atomic<int> numFinished(0);
+std::mutex barMutex;
 
 void runIteration(const int iteration, RandomGeneratorType &generator, const uint seed, const int size,
-        const int numLabels, const bool useRePair, const bool verbose, const bool extraVerbose,
-        Statistics &statistics, ProgressBar &bar, const string &treePath) {
+        const int numLabels, const SyntheticTreeParameters *workload, const bool useRePair, const bool verbose, const bool extraVerbose,
+        Statistics &statistics, ProgressBar &bar, const string &treePath, WorkStealingPool &unpackPool) {
     // Seed RNG
     generator.seed(seed);
     if (verbose) cout << endl << "Round " << iteration << ", seed is " <<seed << endl;
@@ -68,12 +160,21 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
     RandomTreeGenerator<RandomGeneratorType> rand(generator);
 
     Timer timer;
+    PhaseMemory memory;
 
     // Generate random tree
-    rand.generateTree(tree, size);
-    RandomLabels<RandomGeneratorType> labels(size+1, numLabels, generator);
+    ScopedPhase generation("generate");
+    if (workload == nullptr) rand.generateTree(tree, size);
+    RandomLabels<RandomGeneratorType> labels(workload == nullptr ? size + 1 : 0, numLabels, generator);
+    if (workload != nullptr) {
+        SyntheticTreeGenerator<RandomGeneratorType> synthetic(generator, *workload);
+        synthetic.generateTree(tree, labels.labels, size);
+    }
 
     debugInfo.generationDuration = timer.get();
+    generation.stop();
+    memory.next(&debugInfo.generationMemory);
+    debugInfo.numNodes = tree._numNodes;
     if (verbose) cout << "Generated " << tree.summary() << " in " << timer.get() << "ms" << endl;
     timer.reset();
 
@@ -90,7 +191,11 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
     debugInfo.avgDepth = tree.avgDepth();
     debugInfo.statDuration = timer.getAndReset();
 
+    // don't attribute the copy, statistics and I/O to the construction
+    memory.next(NULL);
+
     // Construct top tree
+    ScopedPhase construction("construct");
     TopDag<int> dag(tree._numNodes, labels);
     if (useRePair) {
         RePairCombiner<OrderedTree<TreeNode, TreeEdge>, int> topDagConstructor(tree, dag, verbose, extraVerbose);
@@ -99,6 +204,8 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
         TopDagConstructor<OrderedTree<TreeNode, TreeEdge>, int> topDagConstructor(tree, dag, verbose, extraVerbose);
         topDagConstructor.construct(&debugInfo);
     }
+    memory.next(&debugInfo.mergeMemory);
+    construction.stop();
 
     debugInfo.mergeDuration = timer.get();
     if (verbose)
@@ -113,6 +220,9 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
 */
 
     // Unpack top DAG to topTree
+    memory.next(NULL);
+    ScopedPhase unpacking("unpack");
+    PhaseCounters unpackCounters;
     TopTree<int> topTree(size + 1);
     TopDagUnpacker<int> dagUnpacker(dag, topTree);
     dagUnpacker.unpack();
@@ -122,6 +232,9 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
     Labels<int> newLabels(size + 1);
     TopTreeUnpacker<OrderedTree<TreeNode, TreeEdge>, int> treeUnpacker(topTree, unpackedTree, newLabels);
     treeUnpacker.unpack();
+    unpackCounters.next(&debugInfo.unpackCounters);
+    memory.next(&debugInfo.unpackMemory);
+    unpacking.stop();
     debugInfo.unpackDuration = timer.get();
     if (verbose) cout << "Unpacked top tree in " << timer.get() << "ms" << flush;
     timer.reset();
@@ -130,6 +243,28 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
     if (!unpackedTree.isEqual<LabelsT<int>>(treeCopy, newLabels, labels)) {
         std::cerr << "Top Tree unpacking produced incorrect result for seed " << seed << endl;
     }
+
+    // Unpack the top DAG again, directly into a tree
+    OrderedTree<TreeNode, TreeEdge> directTree;
+    Labels<int> directLabels(size + 1);
+    TopDagTreeUnpacker<OrderedTree<TreeNode, TreeEdge>, int> directUnpacker(dag, directTree, directLabels);
+    directUnpacker.unpack();
+    if (!directTree.isEqual<LabelsT<int>>(treeCopy, directLabels, labels)) {
+        std::cerr << "Direct Top DAG unpacking produced incorrect result for seed " << seed << endl;
+    }
+
+    // ...and in parallel
+    OrderedTree<TreeNode, TreeEdge> parallelTree;
+    Labels<int> parallelLabels(size + 1);
+    ParallelTreeUnpacker<OrderedTree<TreeNode, TreeEdge>, int> parallelUnpacker(dag, parallelTree, parallelLabels, unpackPool);
+    parallelUnpacker.unpack();
+    if (!parallelTree.isEqual<LabelsT<int>>(treeCopy, parallelLabels, labels)) {
+        std::cerr << "Parallel Top DAG unpacking produced incorrect result for seed " << seed << endl;
+    }
+
+    // Evaluate random XPath queries on the DAG
+    verifyXPath(dag, treeCopy, labels, generator, seed);
+
     debugInfo.statDuration += timer.get();
     if (verbose) cout << "; checked in " << timer.get() << "ms" << endl;
     timer.reset();
@@ -142,10 +277,13 @@ void runIteration(const int iteration, RandomGeneratorType &generator, const uin
         if (verbose) cout << "Wrote recovered tree in " << timer.get() << "ms" << endl;
     }
 
-    debugMutex.lock();
     statistics.addDebugInfo(debugInfo);
-    ++bar;
-    debugMutex.unlock();
+    ++numFinished;
+    // the bar is drawn by any thread that doesn't have to wait for it
+    if (barMutex.try_lock()) {
+        bar.stepto(numFinished);
+        barMutex.unlock();
+    }
 }
 
 int main(int argc, char **argv) {
@@ -160,6 +298,7 @@ int main(int argc, char **argv) {
     const int numIterations = argParser.get<int>("n", 100);
     const uint numLabels = argParser.get<uint>("l", 2);
     const uint seed = argParser.get<uint>("s", 12345678);
+    const string workloadName = argParser.get<string>("d", "uniform");
     const bool useRePair = argParser.isSet("r");
     const bool verbose = argParser.isSet("v") || argParser.isSet("vv");
     const bool extraVerbose = argParser.isSet("vv");
@@ -171,6 +310,17 @@ int main(int argc, char **argv) {
         makePathRecursive(treePath);
     }
 
+    SyntheticTreeParameters workload;
+    if (workloadName != "uniform" && !workload.setWorkload(workloadName, numLabels)) {
+        cout << "Unknown tree shape: " << workloadName << endl;
+        usage(argv[0]);
+        return 1;
+    }
+    const SyntheticTreeParameters *workloadPtr = (workloadName == "uniform") ? nullptr : &workload;
+
+    HardwareCounters::setEnabled(argParser.isSet("p"));
+    MemoryUsage::setEnabled(argParser.isSet("a"));
+
     int numWorkers(std::thread::hardware_concurrency());
     numWorkers = argParser.get<int>("t", numWorkers);
 
@@ -179,7 +329,7 @@ int main(int argc, char **argv) {
     ProgressBar bar(numIterations, std::cerr);
 
     cout << "Running experiments with " << numIterations << " trees of size " << size << " with " << numLabels
-         << " different labels" << flush;
+         << " different labels (" << workloadName << " shape)" << flush;
 
     // Generate seeds deterministically from the input parameters
     vector<uint> seeds(numIterations);
@@ -191,33 +341,23 @@ int main(int argc, char **argv) {
         seeds[0] = seed;
     }
 
-    // function that the threads will execute
-    auto worker = [&](int start, int end) {
-        RandomGeneratorType engine{};
-        for (int i = start; i < end; ++i) {
-            runIteration(i, engine, seeds[i], size, numLabels, useRePair, verbose, extraVerbose, statistics, bar, treePath);
-        }
-    };
-
-    const int treesPerThread = numIterations / numWorkers;
-    const int leftovers = numIterations % numWorkers;
-
-    vector<std::thread> workers;
+    WorkStealingPool pool(numWorkers);
+    cout << " using " << pool.getNumThreads() << " threads" << endl;
 
-    cout << " using " << numWorkers << " threads" << endl;
-
-    int min(0), max(treesPerThread);
-    for (int i = 0; i < numWorkers; ++i) {
-        if (i < leftovers) {
-            max++;
-        }
-        workers.push_back(std::thread(worker, min, max));
-        min = max;
-        max += treesPerThread;
+    // every thread has its own random generator and statistics, which are merged at the end
+    vector<RandomGeneratorType> engines(pool.getNumThreads());
+    vector<Statistics> threadStatistics(pool.getNumThreads());
+    // a pool runs one batch at a time, so every thread unpacks in parallel on a pool of its own
+    vector<std::unique_ptr<WorkStealingPool>> unpackPools;
+    for (int i = 0; i < pool.getNumThreads(); ++i) {
+        unpackPools.emplace_back(new WorkStealingPool(2));
     }
-
-    for (std::thread &worker : workers) {
-        worker.join();
+    pool.run(numIterations, [&](const size_t i, const int threadId) {
+        runIteration(i, engines[threadId], seeds[i], size, numLabels, workloadPtr, useRePair, verbose, extraVerbose,
+                     threadStatistics[threadId], bar, treePath, *unpackPools[threadId]);
+    });
+    for (const Statistics &threadStats : threadStatistics) {
+        statistics.merge(threadStats);
     }
 
     bar.undraw();
@@ -1,7 +1,8 @@
 /*
  * Strip noise from an XML file
  *
- * Removes everything except the tag names
+ * Removes everything except the tag names. With -b, also writes the
+ * tree as a BP file, which the other tools load without parsing XML.
  */
 
 #include <iostream>
@@ -11,6 +12,7 @@
 #include "Nodes.h"
 #include "OrderedTree.h"
 
+#include "BPFile.h"
 #include "XML.h"
 
 #include "ArgParser.h"
@@ -28,9 +30,13 @@ int main(int argc, char **argv) {
     string filename = argParser.get<string>("i", "data/1998statistics.xml");
     string outputfolder = argParser.get<string>("o", "/tmp");
     const bool indent = argParser.isSet("p");
+    const bool writeBP = argParser.isSet("b");
 
     // Read input file
-    XmlParser<OrderedTree<TreeNode, TreeEdge>>::parse(filename, t, labels);
+    if (!readTreeFile(filename, t, labels)) {
+        cout << "Could not parse input file, aborting" << endl;
+        exit(1);
+    }
 
     const int nodes(t._numNodes), height(t.height());
     const double avgDepth(t.avgDepth());
@@ -44,6 +50,15 @@ int main(int argc, char **argv) {
 
     cout << "Wrote trimmed XML file in " << timer.getAndReset() << "ms: " << t.summary() << endl;
 
+    if (writeBP) {
+        const string bpname = outputfolder + "/" + filename.substr(pos + 1) + ".bp";
+        if (!BPFile::write(t, labels, bpname)) {
+            cout << "Could not write " << bpname << endl;
+            return 1;
+        }
+        cout << "Wrote BP file " << bpname << " in " << timer.getAndReset() << "ms" << endl;
+    }
+
     // Get size
     std::ifstream in(filename, std::ifstream::ate | std::ifstream::binary);
     auto origSize = in.tellg();
@@ -25,7 +25,9 @@
 // Utils
 #include "ArgParser.h"
 #include "DotGraphExporter.h"
-#include "Timer.h"
+#include "MergeProfile.h"
+#include "PhaseTimer.h"
+#include "BPFile.h"
 #include "XML.h"
 
 
@@ -46,10 +48,17 @@ int main(int argc, char **argv) {
         filename = (arg == "") ? filename : arg;
     }
     const bool writeDotFiles = argParser.isSet("w");
+    const string profileFilename = argParser.get<string>("p", "");
 
     Labels<string> labels;
 
-    XmlParser<OrderedTree<TreeNode, TreeEdge>>::parse(filename, t, labels);
+    {
+        ScopedPhase parsing("parse");
+        if (!readTreeFile(filename, t, labels)) {
+            cout << "Could not parse input file, aborting" << endl;
+            exit(1);
+        }
+    }
 
     cout << t.summary() << "; Height: " << t.height() << " Avg depth: " << t.avgDepth() << endl;
 
@@ -60,18 +69,27 @@ int main(int argc, char **argv) {
     const int treeEdges = t._numEdges;
     TopDag<string> topDag(t._numNodes, labels);
 
-    Timer timer;
+    MergeProfile profile;
+    ScopedPhase construction("construct");
     if (useRePair) {
         RePairCombiner<OrderedTree<TreeNode, TreeEdge>, string> topDagConstructor(t, topDag);
+        if (profileFilename != "") topDagConstructor.setProfile(&profile);
         topDagConstructor.construct();
     } else {
         TopDagConstructor<OrderedTree<TreeNode, TreeEdge>, string> topDagConstructor(t, topDag);
+        if (profileFilename != "") topDagConstructor.setProfile(&profile);
         topDagConstructor.construct();
     }
-    cout << "Top DAG construction took " << timer.getAndReset() << "ms" << endl;
+    cout << "Top DAG construction took " << construction.stop() << "ms" << endl;
+
+    if (profileFilename != "" && !profile.write(profileFilename)) {
+        cout << "Could not write merge profile to " << profileFilename << endl;
+    }
     //, avg node depth " << topTree.avgDepth() << " (min " << topTree.minDepth() << "); took " << timer.getAndReset() << " ms" << endl;
 
+    ScopedPhase dagStatistics("dag");
     const int edges = topDag.countEdges();
+    dagStatistics.stop();
     const double percentage = (edges * 100.0) / treeEdges;
     const double ratio = ((int)(1000 / percentage)) / 10.0;
     cout << "Top dag has " << topDag.nodes.size() - 1 << " nodes, " << edges << " edges (" << percentage
@@ -82,5 +100,8 @@ int main(int argc, char **argv) {
         DotGraphExporter<TopDag<string>>::drawSvg("/tmp/topdag.dot", "/tmp/topdag.svg");
     }
 
+    cout << endl << "Phase times:" << endl;
+    PhaseTimers::merged().writeSummary(cout);
+
     return 0;
 }
@@ -12,10 +12,14 @@
 #include "Nodes.h"
 #include "OrderedTree.h"
 #include "TopDag.h"
+#include "BPFile.h"
 #include "XML.h"
 #include "Timer.h"
 
 #include "TopDagUnpacker.h"
+#include "TopDagTreeUnpacker.h"
+#include "ParallelTreeUnpacker.h"
+#include "TopDagBPUnpacker.h"
 #include "TopDagConstructor.h"
 #include "RePairCombiner.h"
 #include "TopTreeUnpacker.h"
@@ -37,7 +41,10 @@ int main(int argc, char **argv) {
     string outputfolder = argParser.get<string>("o", "/tmp");
 
     // Read input file
-    XmlParser<OrderedTree<TreeNode, TreeEdge>>::parse(filename, t, labels);
+    if (!readTreeFile(filename, t, labels)) {
+        cout << "Could not parse input file, aborting" << endl;
+        exit(1);
+    }
 
     // Dump input file for comparison of output
     Timer timer;
@@ -83,5 +90,50 @@ int main(int argc, char **argv) {
     XmlWriter<OrderedTree<TreeNode, TreeEdge>>::write(recoveredTree, newLabels, outputfolder + "/unpacked.xml");
     cout << "Wrote recovered tree in " << timer.getAndReset() << "ms" << endl;
 
+    // write the XML file straight from the top DAG
+    const unsigned long long numStreamed = XmlWriter<TopDag<string>>::write(dag, outputfolder + "/streamed.xml");
+    cout << "Wrote " << numStreamed << " nodes from the Top DAG in " << timer.getAndReset() << "ms" << endl;
+
+    // unpack top DAG directly, without the top tree
+    OrderedTree<TreeNode, TreeEdge> directTree;
+    Labels<string> directLabels(labels.numKeys());
+    TopDagTreeUnpacker<OrderedTree<TreeNode, TreeEdge>, string> directUnpacker(dag, directTree, directLabels);
+    directUnpacker.unpack();
+    cout << "Unpacked Top DAG directly in " << timer.getAndReset() << "ms: " << directTree.summary() << endl;
+    if (!directTree.isEqual<LabelsT<string>>(recoveredTree, directLabels, newLabels, true)) {
+        cout << "Direct unpacking produced a different tree!" << endl;
+        return 1;
+    }
+
+    // ...and in parallel
+    const int numThreads = argParser.get<int>("t", std::thread::hardware_concurrency());
+    WorkStealingPool pool(numThreads);
+    OrderedTree<TreeNode, TreeEdge> parallelTree;
+    Labels<string> parallelLabels(labels.numKeys());
+    timer.reset();
+    ParallelTreeUnpacker<OrderedTree<TreeNode, TreeEdge>, string> parallelUnpacker(dag, parallelTree, parallelLabels, pool);
+    parallelUnpacker.unpack();
+    cout << "Unpacked Top DAG with " << numThreads << " threads (" << parallelUnpacker.getNumTasks() << " tasks) in "
+         << timer.getAndReset() << "ms: " << parallelTree.summary() << endl;
+    if (!parallelTree.isEqual<LabelsT<string>>(directTree, parallelLabels, directLabels, true)) {
+        cout << "Parallel unpacking produced a different tree!" << endl;
+        return 1;
+    }
+
+    // unpack top DAG to balanced parentheses, copying repeated clusters
+    timer.reset();
+    TopDagBPUnpacker<string> bpUnpacker(dag);
+    bpUnpacker.unpack();
+    cout << "Unpacked Top DAG to BP in " << timer.getAndReset() << "ms: " << bpUnpacker.getExpandedBits()
+         << " parentheses expanded, " << bpUnpacker.getCopiedBits() << " copied" << endl;
+    std::vector<bool> bp, expectedBP;
+    std::vector<unsigned char> labelNames, expectedLabelNames;
+    bpUnpacker.toBPString(bp, labelNames);
+    BPString::fromTree(directTree, directLabels, expectedBP, expectedLabelNames);
+    if (bp != expectedBP || labelNames != expectedLabelNames) {
+        cout << "BP unpacking produced a different tree!" << endl;
+        return 1;
+    }
+
     return 0;
 }
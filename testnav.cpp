@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <limits>
 #include <string>
 
 // Data structures
@@ -21,13 +22,17 @@
 #include "TopTreeUnpacker.h"
 #include "RePairCombiner.h"
 #include "TopDagUnpacker.h"
+#include "MappedTopDag.h"
 #include "Navigation.h"
 #include "NavTest.h"
+#include "PathQuery.h"
+#include "XPath.h"
 
 // Utils
 #include "ArgParser.h"
 #include "DotGraphExporter.h"
 #include "Timer.h"
+#include "BPFile.h"
 #include "XML.h"
 
 
@@ -48,13 +53,26 @@ int main(int argc, char **argv) {
         filename = (arg == "") ? filename : arg;
     }
     const bool print = argParser.isSet("p");
+    // also navigate on a serialised copy of the DAG (memory-mapped from disk)
+    const bool mapped = argParser.isSet("m");
+    // compute cluster summaries and check the subtree queries against the tree at random nodes
+    const bool summarise = argParser.isSet("s");
+    // number of random root-to-node path queries to answer in a batch
+    const int numPathQueries = argParser.get<int>("b", 0);
+    // XPath query like /a/b//c to evaluate on the DAG
+    const string xpath = argParser.get<string>("x", "");
 
     Labels<string> labels;
-    XmlParser<OrderedTree<TreeNode, TreeEdge>>::parse(filename, t, labels);
+    if (!readTreeFile(filename, t, labels)) {
+        cout << "Could not parse input file, aborting" << endl;
+        exit(1);
+    }
     cout << t.summary() << "; Height: " << t.height() << " Avg depth: " << t.avgDepth() << endl;
 
     const int treeEdges = t._numEdges;
     TopDag<string> dag(t._numNodes, labels);
+    // the construction consumes the tree, keep a copy to check the summaries against
+    const OrderedTree<TreeNode, TreeEdge> treeCopy(summarise ? t : OrderedTree<TreeNode, TreeEdge>());
 
     Timer timer;
     if (useRePair) {
@@ -104,5 +122,192 @@ int main(int argc, char **argv) {
              << nodesVisited << " nodes; max tree stack size = "
              << maxTreeStackSize << " Bytes" << endl;
 
+    if (summarise) {
+        timer.reset();
+        DagSummaries<string> summaries(dag, true);
+        cout << "Computed DAG summaries (" << summaries.getSize() / 1024 << " KiB) in "
+             << timer.getAndReset() << "ms" << endl;
+
+        Navigator<string> nav(dag, &summaries);
+        const long long size = nav.getSubtreeSize();
+        const int height = nav.getSubtreeHeight();
+        const string rootLabel = *nav.getLabel();
+        const long long rootLabels = nav.countLabelInSubtree(rootLabel);
+        const long long numChildren = nav.getNumChildren();
+        const bool lastChild = nav.childAt(numChildren - 1);
+        const long long lastChildSize = lastChild ? nav.getSubtreeSize() : 0;
+        cout << "Root subtree: " << size << " nodes, height " << height << ", "
+             << rootLabels << " nodes labelled " << rootLabel << ", " << numChildren
+             << " children, last child's subtree has " << lastChildSize << " nodes; took "
+             << timer.get() << "ms" << endl;
+        while (nav.parent()) {}
+
+        // the expected answers for every node of the original tree
+        const int numNodes = treeCopy._numNodes;
+        vector<long long> subtreeSizes(numNodes, 1), ownLabelCounts(numNodes), labelsSeen(labels.valueIndex.size(), 0);
+        vector<int> subtreeHeights(numNodes, 0), depths(numNodes, 0), path;
+        traverseTree(treeCopy, 0,
+            [&](const int nodeId, const int depth) {
+                path.resize(depth);
+                path.push_back(nodeId);
+                depths[nodeId] = depth;
+                ownLabelCounts[nodeId] = -labelsSeen[labels.keys[nodeId]]++;
+            },
+            [&](const int nodeId, const int depth) {
+                ownLabelCounts[nodeId] += labelsSeen[labels.keys[nodeId]];
+                if (depth == 0) return;
+                const int parentId = path[depth - 1];
+                subtreeSizes[parentId] += subtreeSizes[nodeId];
+                subtreeHeights[parentId] = std::max(subtreeHeights[parentId], subtreeHeights[nodeId] + 1);
+            });
+
+        // walk to random nodes on the tree and with childAt(), stopping with probability 1/8 per level
+        RandomGeneratorType generator(12345678);
+        const int numChecks = 10000;
+        // the root has no bottom boundary node, even if its cluster is a vertical merge
+        int numDiffering = (summaries[dag.nodes.size() - 1].boundaryDepth == -1) ? 0 : 1;
+        if (numDiffering > 0) cout << "The root cluster has a bottom boundary node" << endl;
+        timer.reset();
+        for (int check = 0; check < numChecks; ++check) {
+            int nodeId = 0, parentId = -1;
+            bool differs = false;
+            long long numChildren, index = 0;
+            while (true) {
+                // a freshly read tree has no invalid edges
+                numChildren = treeCopy.nodes[nodeId].numEdges();
+                differs |= nav.getSubtreeSize() != subtreeSizes[nodeId] ||
+                           nav.getSubtreeHeight() != subtreeHeights[nodeId] ||
+                           (int)nav.getDepth() != depths[nodeId] ||
+                           nav.getNumChildren() != numChildren ||
+                           *nav.getLabel() != labels[nodeId] ||
+                           nav.countLabelInSubtree(labels[nodeId]) != ownLabelCounts[nodeId];
+                if (differs || numChildren == 0 || generator() % 8 == 0) break;
+                index = generator() % numChildren;
+                differs |= !nav.childAt(index);
+                parentId = nodeId;
+                nodeId = treeCopy.firstEdge(nodeId)[index].headNode;
+            }
+            // there is no child after the last one
+            differs |= nav.childAt(numChildren);
+            if (parentId >= 0) {
+                // skip to a random later sibling, or one past the last
+                const long long numLater = treeCopy.nodes[parentId].numEdges() - 1 - index;
+                const long long skip = 1 + generator() % (numLater + 1);
+                if (skip > numLater) {
+                    differs |= nav.nextSibling(skip);
+                } else {
+                    const int siblingId = treeCopy.firstEdge(parentId)[index + skip].headNode;
+                    differs |= !nav.nextSibling(skip) || *nav.getLabel() != labels[siblingId] ||
+                               nav.getSubtreeSize() != subtreeSizes[siblingId];
+                }
+            }
+            if (differs) {
+                if (numDiffering == 0) {
+                    cout << "Subtree queries at node " << nodeId << " (depth " << depths[nodeId]
+                         << ") differ from the tree" << endl;
+                }
+                ++numDiffering;
+            }
+            while (nav.parent()) {}
+        }
+        cout << "Checked subtree queries at " << numChecks << " random nodes in " << timer.get() << "ms"
+             << (numDiffering == 0 ? "" : ", RESULTS DIFFER at " + std::to_string(numDiffering) + " nodes!") << endl;
+    }
+
+    if (numPathQueries > 0) {
+        DagSummaries<string> summaries(dag);
+        Navigator<string> nav(dag, &summaries);
+        RandomGeneratorType generator(12345678);
+        vector<BatchedPathQuery<string>::Path> paths(numPathQueries);
+        for (auto &path : paths) {
+            // random walk from the root, stopping with probability 1/8 per level
+            long long numChildren;
+            while ((numChildren = nav.getNumChildren()) > 0 && generator() % 8 != 0) {
+                path.push_back(generator() % numChildren);
+                nav.childAt(path.back());
+            }
+            while (nav.parent()) {}
+        }
+
+        // report the best of a few repetitions, as a single batch takes well under a millisecond
+        const int numRepetitions = 5;
+        vector<const string *> expected;
+        double best = std::numeric_limits<double>::max();
+        for (int repetition = 0; repetition < numRepetitions; ++repetition) {
+            timer.reset();
+            expected.clear();
+            for (const auto &path : paths) {
+                for (const long long index : path) nav.childAt(index);
+                expected.push_back(nav.getLabel());
+                while (nav.parent()) {}
+            }
+            best = std::min(best, timer.get());
+        }
+        cout << "Answered " << numPathQueries << " path queries one by one in " << best << "ms (best of "
+             << numRepetitions << ")" << endl;
+
+        for (const bool useSummaries : {false, true}) {
+            best = std::numeric_limits<double>::max();
+            unsigned long long numMoves = 0;
+            bool differ = false;
+            for (int repetition = 0; repetition < numRepetitions; ++repetition) {
+                timer.reset();
+                BatchedPathQuery<string> query(dag, useSummaries ? &summaries : NULL);
+                for (const auto &path : paths) query.addQuery(path);
+                const vector<const string *> result = query.getLabels();
+                best = std::min(best, timer.get());
+                numMoves = query.getNumMoves();
+                differ |= (result != expected);
+            }
+            cout << "Answered " << numPathQueries << " path queries batched " << (useSummaries ? "with" : "without")
+                 << " summaries in " << best << "ms (best of " << numRepetitions << ") using " << numMoves << " moves"
+                 << (differ ? ", RESULTS DIFFER!" : "") << endl;
+        }
+    }
+
+    if (xpath != "") {
+        const auto steps = XPathQuery<string>::parse(xpath);
+        if (steps.empty()) return 1;
+        timer.reset();
+        XPathQuery<string> query(dag, steps);
+        const long long count = query.count();
+        cout << "XPath " << query << " has " << count << " matches; took " << timer.getAndReset()
+             << "ms using " << query.getNumMemoEntries() << " memoised cluster states" << endl;
+
+        DagSummaries<string> summaries(dag);
+        timer.reset();
+        long long listed = 0;
+        query.listMatches(summaries, [&](const XPathQuery<string>::Path &) { ++listed; });
+        cout << "Listed " << listed << " matches in " << timer.get() << "ms"
+             << (listed == count ? "" : ", COUNTS DIFFER!") << endl;
+    }
+
+    if (mapped) {
+        const string dagFile = "/tmp/foo.dag";
+        timer.reset();
+        if (!DagFileWriter<string>::write(dag, dagFile)) {
+            cout << "Could not write " << dagFile << endl;
+            return 1;
+        }
+        MappedTopDag<string> mappedDag(dagFile);
+        if (!mappedDag.isOpen()) {
+            cout << "Could not map " << dagFile << endl;
+            return 1;
+        }
+        cout << "Wrote and mapped " << mappedDag << " in " << timer.getAndReset() << "ms" << endl;
+
+        PreorderTraversal<string, MappedTopDag<string>> mappedTrav(mappedDag, print);
+        std::tie(nodesVisited, maxTreeStackSize) = mappedTrav.run();
+        cout << "Mapped preorder    traversal took " << timer.get() << "ms, visited "
+             << nodesVisited << " nodes; max tree stack size = "
+             << maxTreeStackSize << " Bytes" << endl;
+
+        timer.reset();
+        std::tie(nodesVisited, maxTreeStackSize) = mappedTrav.runRight();
+        cout << "Mapped right-first traversal took " << timer.get() << "ms, visited "
+             << nodesVisited << " nodes; max tree stack size = "
+             << maxTreeStackSize << " Bytes" << endl;
+    }
+
     return 0;
 }